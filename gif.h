@@ -21,6 +21,7 @@
 
 #include <vector>
 #include <cstring>
+#include <algorithm>
 #include <stdio.h>
 
 #include "pcsx2defs.h"
@@ -203,6 +204,7 @@ struct GsPacket
 };
 
 GsPacket read_gs_packet(u8 *data, int size);
+int gs_packet_size(const u8 *data, int size);
 GifTag read_gif_tag(u64 high_part, u64 low_part);
 void interpret_packed_data(GsPackedData &item);
 int bit_range(u64 val, int lo, int hi);
@@ -252,6 +254,29 @@ GsPacket read_gs_packet(u8 *data, int size)
 	return packet;
 }
 
+// Walks the GIFtags to find how many bytes an XGKICK would transfer, without
+// decoding any of the data. Clamped to size.
+int gs_packet_size(const u8 *data, int size)
+{
+	int pos = 0;
+	while(pos + 0x10 <= size) {
+		u64 low_tag = *(const u64*) &data[pos];
+		pos += 0x10;
+		int nloop = bit_range(low_tag, 0, 14);
+		int nregs = bit_range(low_tag, 60, 63);
+		if(nregs == 0) nregs = 16;
+		switch(bit_range(low_tag, 58, 59)) {
+			case GIFFLAG_PACKED: pos += nloop * nregs * 0x10; break;
+			case GIFFLAG_REGLIST: pos += (nloop * nregs * 8 + 0xf) & ~0xf; break;
+			default: pos += nloop * 0x10;
+		}
+		if(bit_range(low_tag, 15, 15)) {
+			break;
+		}
+	}
+	return std::min(pos, size);
+}
+
 GifTag read_gif_tag(u64 high_part, u64 low_part)
 {
 	int prim_raw = bit_range(low_part, 47, 57);
@@ -0,0 +1,475 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <ctype.h>
+#include <stdlib.h>
+
+#include "pcsx2defs.h"
+
+// Small expression language used to filter snapshots, for example:
+//   pc == 0x1a8 && vi03 > 4 && mem.f[0x3f0].w != 1.0
+// Expressions are compiled once into a postfix program for a stack machine.
+
+enum QueryOpcode
+{
+	QOP_CONSTANT,
+	QOP_PC,
+	QOP_INDEX,
+	QOP_LOAD,
+	QOP_STORE,
+	QOP_VI,       // operand = register index
+	QOP_VF,       // operand = register index * 4 + lane
+	QOP_ACC,      // operand = lane
+	QOP_Q,
+	QOP_P,
+	QOP_MEM_FLOAT, // pops a byte address, operand = byte offset of the lane
+	QOP_MEM_INT,   // pops a byte address, operand = byte offset of the lane
+	QOP_NEGATE,
+	QOP_NOT,
+	QOP_MUL,
+	QOP_DIV,
+	QOP_MOD,
+	QOP_ADD,
+	QOP_SUB,
+	QOP_LT,
+	QOP_LE,
+	QOP_GT,
+	QOP_GE,
+	QOP_EQ,
+	QOP_NE,
+	QOP_BITAND,
+	QOP_BITXOR,
+	QOP_BITOR,
+	QOP_AND,
+	QOP_OR
+};
+
+struct QueryOp
+{
+	QueryOpcode opcode;
+	u32 operand;
+	double constant;
+};
+
+struct Query
+{
+	std::vector<QueryOp> program;
+	int stack_size = 0;
+};
+
+// Everything a query can look at for a single snapshot. The load and store
+// addresses belong to the instruction executed at this snapshot, or are -1.
+struct QueryContext
+{
+	const VURegs *registers;
+	const u8 *memory;
+	std::size_t index;
+	s64 load;
+	s64 store;
+};
+
+static const int QUERY_MAX_STACK = 64;
+
+bool compile_query(Query &dest, const std::string &text, std::string &error);
+double evaluate_query(const Query &query, const QueryContext &ctx);
+
+enum QueryTokenType
+{
+	QTOK_END,
+	QTOK_NUMBER,
+	QTOK_IDENTIFIER,
+	QTOK_LANE,
+	QTOK_OPERATOR
+};
+
+struct QueryToken
+{
+	QueryTokenType type;
+	std::string text;
+	double number;
+};
+
+struct QueryCompiler
+{
+	std::vector<QueryToken> tokens;
+	std::size_t pos = 0;
+	Query *query;
+	int depth = 0;
+	std::string error;
+
+	const QueryToken &peek() { return tokens[pos]; }
+	bool accept(const char *op)
+	{
+		if(tokens[pos].type == QTOK_OPERATOR && tokens[pos].text == op) {
+			pos++;
+			return true;
+		}
+		return false;
+	}
+	bool fail(const std::string &message)
+	{
+		if(error.empty()) error = message;
+		return false;
+	}
+
+	void emit(QueryOpcode opcode, u32 operand = 0, double constant = 0.0);
+	bool tokenize(const std::string &text);
+	bool parse_binary(int level);
+	bool parse_unary();
+	bool parse_primary();
+	bool parse_identifier(const std::string &name);
+};
+
+static double apply_query_op(QueryOpcode opcode, double lhs, double rhs)
+{
+	switch(opcode) {
+		case QOP_MUL: return lhs * rhs;
+		case QOP_DIV: return rhs != 0.0 ? lhs / rhs : 0.0;
+		case QOP_MOD: return (s64) rhs != 0 ? (double) ((s64) lhs % (s64) rhs) : 0.0;
+		case QOP_ADD: return lhs + rhs;
+		case QOP_SUB: return lhs - rhs;
+		case QOP_LT: return lhs < rhs;
+		case QOP_LE: return lhs <= rhs;
+		case QOP_GT: return lhs > rhs;
+		case QOP_GE: return lhs >= rhs;
+		case QOP_EQ: return lhs == rhs;
+		case QOP_NE: return lhs != rhs;
+		case QOP_BITAND: return (double) ((s64) lhs & (s64) rhs);
+		case QOP_BITXOR: return (double) ((s64) lhs ^ (s64) rhs);
+		case QOP_BITOR: return (double) ((s64) lhs | (s64) rhs);
+		case QOP_AND: return lhs != 0.0 && rhs != 0.0;
+		case QOP_OR: return lhs != 0.0 || rhs != 0.0;
+		default: return 0.0;
+	}
+}
+
+void QueryCompiler::emit(QueryOpcode opcode, u32 operand, double constant)
+{
+	std::vector<QueryOp> &program = query->program;
+
+	// Fold operations on constants at compile time.
+	if(opcode >= QOP_MUL && program.size() >= 2
+		&& program[program.size() - 1].opcode == QOP_CONSTANT
+		&& program[program.size() - 2].opcode == QOP_CONSTANT) {
+		double rhs = program.back().constant;
+		program.pop_back();
+		program.back().constant = apply_query_op(opcode, program.back().constant, rhs);
+		depth--;
+		return;
+	}
+	if((opcode == QOP_NEGATE || opcode == QOP_NOT) && !program.empty() && program.back().opcode == QOP_CONSTANT) {
+		double &value = program.back().constant;
+		value = opcode == QOP_NEGATE ? -value : value == 0.0;
+		return;
+	}
+
+	program.push_back({opcode, operand, constant});
+	if(opcode <= QOP_P) {
+		depth++;
+	} else if(opcode >= QOP_MUL) {
+		depth--;
+	}
+	if(depth > query->stack_size) {
+		query->stack_size = depth;
+	}
+}
+
+bool QueryCompiler::tokenize(const std::string &text)
+{
+	const char *ptr = text.c_str();
+	for(;;) {
+		while(*ptr == ' ' || *ptr == '\t') ptr++;
+		if(*ptr == '\0') {
+			break;
+		}
+		QueryToken token;
+		if((*ptr >= '0' && *ptr <= '9') || (*ptr == '.' && ptr[1] >= '0' && ptr[1] <= '9')) {
+			char *end;
+			if(ptr[0] == '0' && (ptr[1] == 'x' || ptr[1] == 'X')) {
+				token.number = (double) strtoull(ptr, &end, 16);
+			} else {
+				token.number = strtod(ptr, &end);
+			}
+			token.type = QTOK_NUMBER;
+			token.text = std::string(ptr, (const char*) end);
+			ptr = end;
+		} else if(isalpha(*ptr) || *ptr == '_' || (*ptr == '.' && isalpha(ptr[1]))) {
+			// Identifiers can contain dots e.g. "vf05.x" and "mem.f". A dot at the
+			// start of an identifier selects a lane e.g. the ".w" in "mem.f[0].w".
+			const char *begin = ptr;
+			token.type = *ptr == '.' ? QTOK_LANE : QTOK_IDENTIFIER;
+			if(*ptr == '.') begin = ++ptr;
+			while(isalnum(*ptr) || *ptr == '_' || (*ptr == '.' && isalpha(ptr[1]))) ptr++;
+			token.text = std::string(begin, ptr);
+		} else {
+			static const char *operators[] = {
+				"||", "&&", "==", "!=", "<=", ">=", "<", ">", "+", "-", "*", "/", "%",
+				"!", "&", "^", "|", "(", ")", "[", "]"
+			};
+			token.type = QTOK_OPERATOR;
+			for(const char *op : operators) {
+				if(strncmp(ptr, op, strlen(op)) == 0) {
+					token.text = op;
+					break;
+				}
+			}
+			if(token.text.empty()) {
+				return fail(std::string("Unexpected character '") + *ptr + "'.");
+			}
+			ptr += token.text.size();
+		}
+		tokens.push_back(token);
+	}
+	tokens.push_back({QTOK_END, "", 0.0});
+	return true;
+}
+
+// Binary operators, from lowest to highest precedence.
+static const struct {
+	const char *text;
+	QueryOpcode opcode;
+	int level;
+} QUERY_BINARY_OPERATORS[] = {
+	{"||", QOP_OR, 0},
+	{"&&", QOP_AND, 1},
+	{"|", QOP_BITOR, 2},
+	{"^", QOP_BITXOR, 3},
+	{"&", QOP_BITAND, 4},
+	{"==", QOP_EQ, 5}, {"!=", QOP_NE, 5},
+	{"<", QOP_LT, 6}, {"<=", QOP_LE, 6}, {">", QOP_GT, 6}, {">=", QOP_GE, 6},
+	{"+", QOP_ADD, 7}, {"-", QOP_SUB, 7},
+	{"*", QOP_MUL, 8}, {"/", QOP_DIV, 8}, {"%", QOP_MOD, 8}
+};
+static const int QUERY_BINARY_LEVELS = 9;
+
+bool QueryCompiler::parse_binary(int level)
+{
+	if(level >= QUERY_BINARY_LEVELS) {
+		return parse_unary();
+	}
+	if(!parse_binary(level + 1)) {
+		return false;
+	}
+	for(;;) {
+		bool matched = false;
+		for(auto &op : QUERY_BINARY_OPERATORS) {
+			if(op.level == level && accept(op.text)) {
+				if(!parse_binary(level + 1)) {
+					return false;
+				}
+				emit(op.opcode);
+				matched = true;
+				break;
+			}
+		}
+		if(!matched) {
+			return true;
+		}
+	}
+}
+
+bool QueryCompiler::parse_unary()
+{
+	if(accept("-")) {
+		if(!parse_unary()) return false;
+		emit(QOP_NEGATE);
+		return true;
+	}
+	if(accept("!")) {
+		if(!parse_unary()) return false;
+		emit(QOP_NOT);
+		return true;
+	}
+	return parse_primary();
+}
+
+bool QueryCompiler::parse_primary()
+{
+	const QueryToken &token = peek();
+	switch(token.type) {
+		case QTOK_NUMBER: {
+			pos++;
+			emit(QOP_CONSTANT, 0, token.number);
+			return true;
+		}
+		case QTOK_IDENTIFIER: {
+			pos++;
+			return parse_identifier(token.text);
+		}
+		case QTOK_OPERATOR: {
+			if(accept("(")) {
+				if(!parse_binary(0)) return false;
+				if(!accept(")")) return fail("Expected ')'.");
+				return true;
+			}
+			return fail("Unexpected '" + token.text + "'.");
+		}
+		default: {
+			return fail("Unexpected end of expression.");
+		}
+	}
+}
+
+static int parse_query_lane(const std::string &lane)
+{
+	if(lane == "x") return 0;
+	if(lane == "y") return 1;
+	if(lane == "z") return 2;
+	if(lane == "w") return 3;
+	return -1;
+}
+
+bool QueryCompiler::parse_identifier(const std::string &name)
+{
+	std::string lower = name;
+	for(char &c : lower) c = tolower(c);
+
+	if(lower == "pc") { emit(QOP_PC); return true; }
+	if(lower == "index") { emit(QOP_INDEX); return true; }
+	if(lower == "load") { emit(QOP_LOAD); return true; }
+	if(lower == "store") { emit(QOP_STORE); return true; }
+	if(lower == "q") { emit(QOP_Q); return true; }
+	if(lower == "p") { emit(QOP_P); return true; }
+	if(lower == "i") { emit(QOP_VI, 21); return true; }
+	if(lower == "r") { emit(QOP_VI, 20); return true; }
+	if(lower == "status") { emit(QOP_VI, 16); return true; }
+	if(lower == "mac") { emit(QOP_VI, 17); return true; }
+	if(lower == "clip") { emit(QOP_VI, 18); return true; }
+
+	if(lower.size() == 4 && lower.compare(0, 2, "vi") == 0 && isdigit(lower[2]) && isdigit(lower[3])) {
+		int reg = atoi(&lower[2]);
+		if(reg >= 16) return fail("Bad integer register '" + name + "'.");
+		emit(QOP_VI, reg);
+		return true;
+	}
+
+	if(lower.size() == 6 && lower.compare(0, 2, "vf") == 0 && isdigit(lower[2]) && isdigit(lower[3]) && lower[4] == '.') {
+		int reg = atoi(&lower[2]);
+		int lane = parse_query_lane(lower.substr(5));
+		if(reg >= 32 || lane < 0) return fail("Bad float register '" + name + "'.");
+		emit(QOP_VF, reg * 4 + lane);
+		return true;
+	}
+
+	if(lower.size() == 5 && lower.compare(0, 4, "acc.") == 0) {
+		int lane = parse_query_lane(lower.substr(4));
+		if(lane < 0) return fail("Bad lane '" + name + "'.");
+		emit(QOP_ACC, lane);
+		return true;
+	}
+
+	if(lower == "mem.f" || lower == "mem.i") {
+		if(!accept("[")) return fail("Expected '[' after '" + name + "'.");
+		if(!parse_binary(0)) return false;
+		if(!accept("]")) return fail("Expected ']'.");
+		int lane = 0;
+		if(peek().type == QTOK_LANE) {
+			lane = parse_query_lane(peek().text);
+			if(lane < 0) return fail("Bad lane '." + peek().text + "'.");
+			pos++;
+		}
+		emit(lower == "mem.f" ? QOP_MEM_FLOAT : QOP_MEM_INT, lane * 4);
+		return true;
+	}
+
+	return fail("Unknown identifier '" + name + "'.");
+}
+
+bool compile_query(Query &dest, const std::string &text, std::string &error)
+{
+	QueryCompiler compiler;
+	dest = Query();
+	compiler.query = &dest;
+	if(!compiler.tokenize(text)) {
+		error = compiler.error;
+		return false;
+	}
+	if(!compiler.parse_binary(0)) {
+		error = compiler.error;
+		return false;
+	}
+	if(compiler.peek().type != QTOK_END) {
+		error = "Unexpected '" + compiler.peek().text + "'.";
+		return false;
+	}
+	if(dest.stack_size > QUERY_MAX_STACK) {
+		error = "Expression too complex.";
+		return false;
+	}
+	return true;
+}
+
+double evaluate_query(const Query &query, const QueryContext &ctx)
+{
+	double stack[QUERY_MAX_STACK];
+	int top = -1;
+	for(const QueryOp &op : query.program) {
+		switch(op.opcode) {
+			case QOP_CONSTANT: stack[++top] = op.constant; break;
+			case QOP_PC: stack[++top] = ctx.registers->VI[TPC].UL; break;
+			case QOP_INDEX: stack[++top] = (double) ctx.index; break;
+			case QOP_LOAD: stack[++top] = (double) ctx.load; break;
+			case QOP_STORE: stack[++top] = (double) ctx.store; break;
+			case QOP_VI: {
+				// vi00-vi15 are signed 16 bit, I is a float and the rest (the
+				// flag registers, R, TPC etc) are read as full unsigned words.
+				const REG_VI &reg = ctx.registers->VI[op.operand];
+				if(op.operand < 16) {
+					stack[++top] = reg.SS[0];
+				} else if(op.operand == 21) {
+					stack[++top] = reg.F;
+				} else {
+					stack[++top] = reg.UL;
+				}
+				break;
+			}
+			case QOP_VF: stack[++top] = ctx.registers->VF[op.operand / 4].F[op.operand % 4]; break;
+			case QOP_ACC: stack[++top] = ctx.registers->ACC.F[op.operand]; break;
+			case QOP_Q: stack[++top] = ctx.registers->q.F; break;
+			case QOP_P: stack[++top] = ctx.registers->p.F; break;
+			case QOP_MEM_FLOAT:
+			case QOP_MEM_INT: {
+				u32 address = ((u32) (s64) stack[top] + op.operand) & (VU1_MEMSIZE - 4);
+				u32 word;
+				memcpy(&word, &ctx.memory[address], 4);
+				if(op.opcode == QOP_MEM_FLOAT) {
+					float value;
+					memcpy(&value, &word, 4);
+					stack[top] = value;
+				} else {
+					stack[top] = word;
+				}
+				break;
+			}
+			case QOP_NEGATE: stack[top] = -stack[top]; break;
+			case QOP_NOT: stack[top] = stack[top] == 0.0; break;
+			default: {
+				top--;
+				stack[top] = apply_query_op(op.opcode, stack[top], stack[top + 1]);
+			}
+		}
+	}
+	return top >= 0 ? stack[top] : 0.0;
+}
+
+#endif
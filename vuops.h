@@ -0,0 +1,578 @@
+/*
+	vutrace - Hacky VU tracer/debugger.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef VUOPS_H
+#define VUOPS_H
+
+#include "pcsx2defs.h"
+
+// Decodes which registers and memory an instruction reads and writes. Uses
+// the same opcode tables as pcsx2disassemble.h.
+
+// Registers are numbered the same way as in 'r' packets, with memory tacked
+// on the end as a pseudo-register.
+static const u8 VUREG_VF = 0;
+static const u8 VUREG_VI = 32;
+static const u8 VUREG_STATUS = VUREG_VI + 16;
+static const u8 VUREG_MAC = VUREG_VI + 17;
+static const u8 VUREG_CLIP = VUREG_VI + 18;
+static const u8 VUREG_R = VUREG_VI + 20;
+static const u8 VUREG_I = VUREG_VI + 21;
+static const u8 VUREG_ACC = 64;
+static const u8 VUREG_Q = 65;
+static const u8 VUREG_P = 66;
+static const u8 VUREG_COUNT = 67;
+static const u8 VUREG_MEMORY = 67;
+
+// Lane masks have x in bit 0 and w in bit 3.
+static const u8 VULANE_X = 1;
+static const u8 VULANE_Y = 2;
+static const u8 VULANE_Z = 4;
+static const u8 VULANE_W = 8;
+static const u8 VULANE_XYZ = 7;
+static const u8 VULANE_XYZW = 15;
+
+enum VuLaneMapping
+{
+	VUMAP_SAME,   // Destination lane n reads lane n of the operand.
+	VUMAP_FIXED,  // Every destination lane reads all the lanes of the operand.
+	VUMAP_ROTATE  // Destination lane n reads lane (n + 1) % 4 of the operand (MR32).
+};
+
+enum VuMemoryAccess
+{
+	VUMEM_NONE,
+	VUMEM_LOAD,
+	VUMEM_STORE
+};
+
+enum VuControlFlow
+{
+	VUFLOW_NONE,
+	VUFLOW_BRANCH,   // B, IBxx
+	VUFLOW_CALL,     // BAL, JALR
+	VUFLOW_JUMP      // JR
+};
+
+struct VuOperand
+{
+	u8 reg;
+	u8 lanes;
+	u8 mapping = VUMAP_SAME;
+	u8 defs = 0xff; // For uses, a mask of the defs that read this operand.
+	bool address = false; // Only used to calculate a memory address.
+};
+
+struct VuInsn
+{
+	VuOperand defs[4];
+	VuOperand uses[6];
+	int def_count = 0;
+	int use_count = 0;
+	VuMemoryAccess memory = VUMEM_NONE;
+	VuControlFlow flow = VUFLOW_NONE;
+	bool is_xgkick = false;
+	bool is_float = false; // Writes floating point results.
+
+	int def(u8 reg, u8 lanes)
+	{
+		// Writes to vf00 and vi00 are discarded.
+		if(reg == VUREG_VF || reg == VUREG_VI) {
+			return -1;
+		}
+		defs[def_count] = {reg, lanes};
+		return def_count++;
+	}
+	void use(u8 reg, u8 lanes, u8 mapping = VUMAP_SAME, u8 def_mask = 0xff, bool address = false)
+	{
+		uses[use_count++] = {reg, lanes, mapping, def_mask, address};
+	}
+};
+
+struct VuInsnPair
+{
+	VuInsn lower;
+	VuInsn upper;
+	bool is_end; // E bit.
+};
+
+static inline bool vu_register_is_vector(u8 reg)
+{
+	return reg < VUREG_VI || reg == VUREG_ACC || reg == VUREG_MEMORY;
+}
+
+// The lanes of an operand that a given lane of a def depends on.
+static inline u8 vu_dependency_lanes(const VuOperand &def, u8 def_lane, const VuOperand &use)
+{
+	if(!vu_register_is_vector(def.reg) || use.mapping == VUMAP_FIXED) {
+		return use.lanes;
+	}
+	if(use.mapping == VUMAP_ROTATE) {
+		return (1 << ((def_lane + 1) % 4)) & use.lanes;
+	}
+	return (1 << def_lane) & use.lanes;
+}
+
+static inline u8 vu_dest_lanes(u32 insn)
+{
+	// The dest field has x in the most significant bit.
+	return ((insn >> 24) & 1) | ((insn >> 22) & 2) | ((insn >> 20) & 4) | ((insn >> 18) & 8);
+}
+
+static VuInsn decode_lower(u32 insn)
+{
+	VuInsn result;
+	u8 ft = (insn >> 16) & 0x1f;
+	u8 fs = (insn >> 11) & 0x1f;
+	u8 it = VUREG_VI + (ft & 0xf);
+	u8 is = VUREG_VI + (fs & 0xf);
+	u8 id = VUREG_VI + ((insn >> 6) & 0xf);
+	u8 dest = vu_dest_lanes(insn);
+	u8 fsf = 1 << ((insn >> 21) & 3);
+	u8 ftf = 1 << ((insn >> 23) & 3);
+
+	auto efu = [&](u8 lanes) {
+		result.def(VUREG_P, VULANE_X);
+		result.use(VUREG_VF + fs, lanes, VUMAP_FIXED);
+		result.is_float = true;
+	};
+
+	switch(insn >> 25) {
+		case 0x00: { // LQ
+			result.def(VUREG_VF + ft, dest);
+			result.use(VUREG_MEMORY, dest);
+			result.use(is, VULANE_X, VUMAP_FIXED, 0xff, true);
+			result.memory = VUMEM_LOAD;
+			break;
+		}
+		case 0x01: { // SQ
+			result.def(VUREG_MEMORY, dest);
+			result.use(VUREG_VF + fs, dest);
+			result.use(it, VULANE_X, VUMAP_FIXED, 0xff, true);
+			result.memory = VUMEM_STORE;
+			break;
+		}
+		case 0x04: { // ILW
+			result.def(it, VULANE_X);
+			result.use(VUREG_MEMORY, dest, VUMAP_FIXED);
+			result.use(is, VULANE_X, VUMAP_FIXED, 0xff, true);
+			result.memory = VUMEM_LOAD;
+			break;
+		}
+		case 0x05: { // ISW
+			result.def(VUREG_MEMORY, dest);
+			result.use(it, VULANE_X, VUMAP_FIXED);
+			result.use(is, VULANE_X, VUMAP_FIXED, 0xff, true);
+			result.memory = VUMEM_STORE;
+			break;
+		}
+		case 0x08: // IADDIU
+		case 0x09: { // ISUBIU
+			result.def(it, VULANE_X);
+			result.use(is, VULANE_X);
+			break;
+		}
+		case 0x10: // FCEQ
+		case 0x12: // FCAND
+		case 0x13: { // FCOR
+			result.def(VUREG_VI + 1, VULANE_X);
+			result.use(VUREG_CLIP, VULANE_X);
+			break;
+		}
+		case 0x11: { // FCSET
+			result.def(VUREG_CLIP, VULANE_X);
+			break;
+		}
+		case 0x14: // FSEQ
+		case 0x16: // FSAND
+		case 0x17: { // FSOR
+			result.def(it, VULANE_X);
+			result.use(VUREG_STATUS, VULANE_X);
+			break;
+		}
+		case 0x15: { // FSSET
+			result.def(VUREG_STATUS, VULANE_X);
+			break;
+		}
+		case 0x18: // FMEQ
+		case 0x1a: // FMAND
+		case 0x1b: { // FMOR
+			result.def(it, VULANE_X);
+			result.use(VUREG_MAC, VULANE_X);
+			result.use(is, VULANE_X);
+			break;
+		}
+		case 0x1c: { // FCGET
+			result.def(it, VULANE_X);
+			result.use(VUREG_CLIP, VULANE_X);
+			break;
+		}
+		case 0x20: { // B
+			result.flow = VUFLOW_BRANCH;
+			break;
+		}
+		case 0x21: { // BAL
+			result.def(it, VULANE_X);
+			result.flow = VUFLOW_CALL;
+			break;
+		}
+		case 0x24: { // JR
+			result.use(is, VULANE_X);
+			result.flow = VUFLOW_JUMP;
+			break;
+		}
+		case 0x25: { // JALR
+			result.def(it, VULANE_X);
+			result.use(is, VULANE_X);
+			result.flow = VUFLOW_CALL;
+			break;
+		}
+		case 0x28: // IBEQ
+		case 0x29: { // IBNE
+			result.use(it, VULANE_X);
+			result.use(is, VULANE_X);
+			result.flow = VUFLOW_BRANCH;
+			break;
+		}
+		case 0x2c: // IBLTZ
+		case 0x2d: // IBGTZ
+		case 0x2e: // IBLEZ
+		case 0x2f: { // IBGEZ
+			result.use(is, VULANE_X);
+			result.flow = VUFLOW_BRANCH;
+			break;
+		}
+		case 0x40: {
+			switch(insn & 0x3f) {
+				case 0x30: // IADD
+				case 0x31: // ISUB
+				case 0x34: // IAND
+				case 0x35: { // IOR
+					result.def(id, VULANE_X);
+					result.use(is, VULANE_X);
+					result.use(it, VULANE_X);
+					break;
+				}
+				case 0x32: { // IADDI
+					result.def(it, VULANE_X);
+					result.use(is, VULANE_X);
+					break;
+				}
+				case 0x3c:
+				case 0x3d:
+				case 0x3e:
+				case 0x3f: {
+					switch(((insn & 3) << 5) | ((insn >> 6) & 0x1f)) {
+						case 0x0c: { // MOVE
+							result.def(VUREG_VF + ft, dest);
+							result.use(VUREG_VF + fs, dest);
+							break;
+						}
+						case 0x0d: { // LQI
+							int data = result.def(VUREG_VF + ft, dest);
+							int pointer = result.def(is, VULANE_X);
+							result.use(VUREG_MEMORY, dest, VUMAP_SAME, data >= 0 ? 1 << data : 0);
+							result.use(is, VULANE_X, VUMAP_FIXED, data >= 0 ? 1 << data : 0, true);
+							result.use(is, VULANE_X, VUMAP_FIXED, pointer >= 0 ? 1 << pointer : 0);
+							result.memory = VUMEM_LOAD;
+							break;
+						}
+						case 0x0e: { // DIV
+							result.def(VUREG_Q, VULANE_X);
+							result.use(VUREG_VF + fs, fsf, VUMAP_FIXED);
+							result.use(VUREG_VF + ft, ftf, VUMAP_FIXED);
+							result.is_float = true;
+							break;
+						}
+						case 0x0f: { // MTIR
+							result.def(it, VULANE_X);
+							result.use(VUREG_VF + fs, fsf, VUMAP_FIXED);
+							break;
+						}
+						case 0x10: { // RNEXT
+							result.def(VUREG_VF + ft, dest);
+							result.def(VUREG_R, VULANE_X);
+							result.use(VUREG_R, VULANE_X, VUMAP_FIXED);
+							break;
+						}
+						case 0x19: { // MFP
+							result.def(VUREG_VF + ft, dest);
+							result.use(VUREG_P, VULANE_X, VUMAP_FIXED);
+							break;
+						}
+						case 0x1a: { // XTOP
+							result.def(it, VULANE_X);
+							break;
+						}
+						case 0x1b: { // XGKICK
+							result.use(is, VULANE_X, VUMAP_FIXED, 0xff, true);
+							result.is_xgkick = true;
+							break;
+						}
+						case 0x1c: efu(VULANE_XYZ); break; // ESADD
+						case 0x1d: efu(VULANE_X | VULANE_Y); break; // EATANxy
+						case 0x1e: efu(fsf); break; // ESQRT
+						case 0x1f: efu(fsf); break; // ESIN
+						case 0x2c: { // MR32
+							result.def(VUREG_VF + ft, dest);
+							result.use(VUREG_VF + fs, VULANE_XYZW, VUMAP_ROTATE);
+							break;
+						}
+						case 0x2d: { // SQI
+							int data = result.def(VUREG_MEMORY, dest);
+							int pointer = result.def(it, VULANE_X);
+							result.use(VUREG_VF + fs, dest, VUMAP_SAME, 1 << data);
+							result.use(it, VULANE_X, VUMAP_FIXED, 1 << data, true);
+							result.use(it, VULANE_X, VUMAP_FIXED, pointer >= 0 ? 1 << pointer : 0);
+							result.memory = VUMEM_STORE;
+							break;
+						}
+						case 0x2e: { // SQRT
+							result.def(VUREG_Q, VULANE_X);
+							result.use(VUREG_VF + ft, ftf, VUMAP_FIXED);
+							result.is_float = true;
+							break;
+						}
+						case 0x2f: { // MFIR
+							result.def(VUREG_VF + ft, dest);
+							result.use(is, VULANE_X, VUMAP_FIXED);
+							break;
+						}
+						case 0x30: { // RGET
+							result.def(VUREG_VF + ft, dest);
+							result.use(VUREG_R, VULANE_X, VUMAP_FIXED);
+							break;
+						}
+						case 0x3a: { // XITOP
+							result.def(it, VULANE_X);
+							break;
+						}
+						case 0x3c: efu(VULANE_XYZ); break; // ERSADD
+						case 0x3d: efu(VULANE_X | VULANE_Z); break; // EATANxz
+						case 0x3e: efu(fsf); break; // ERSQRT
+						case 0x3f: efu(fsf); break; // EATAN
+						case 0x4d: { // LQD
+							int data = result.def(VUREG_VF + ft, dest);
+							int pointer = result.def(is, VULANE_X);
+							result.use(VUREG_MEMORY, dest, VUMAP_SAME, data >= 0 ? 1 << data : 0);
+							result.use(is, VULANE_X, VUMAP_FIXED, data >= 0 ? 1 << data : 0, true);
+							result.use(is, VULANE_X, VUMAP_FIXED, pointer >= 0 ? 1 << pointer : 0);
+							result.memory = VUMEM_LOAD;
+							break;
+						}
+						case 0x4e: { // RSQRT
+							result.def(VUREG_Q, VULANE_X);
+							result.use(VUREG_VF + fs, fsf, VUMAP_FIXED);
+							result.use(VUREG_VF + ft, ftf, VUMAP_FIXED);
+							result.is_float = true;
+							break;
+						}
+						case 0x4f: { // ILWR
+							result.def(it, VULANE_X);
+							result.use(VUREG_MEMORY, dest, VUMAP_FIXED);
+							result.use(is, VULANE_X, VUMAP_FIXED, 0xff, true);
+							result.memory = VUMEM_LOAD;
+							break;
+						}
+						case 0x50: { // RINIT
+							result.def(VUREG_R, VULANE_X);
+							result.use(VUREG_VF + fs, fsf, VUMAP_FIXED);
+							break;
+						}
+						case 0x5c: efu(VULANE_XYZ); break; // ELENG
+						case 0x5d: efu(VULANE_XYZW); break; // ESUM
+						case 0x5e: efu(fsf); break; // ERCPR
+						case 0x5f: efu(fsf); break; // EEXP
+						case 0x6d: { // SQD
+							int data = result.def(VUREG_MEMORY, dest);
+							int pointer = result.def(it, VULANE_X);
+							result.use(VUREG_VF + fs, dest, VUMAP_SAME, 1 << data);
+							result.use(it, VULANE_X, VUMAP_FIXED, 1 << data, true);
+							result.use(it, VULANE_X, VUMAP_FIXED, pointer >= 0 ? 1 << pointer : 0);
+							result.memory = VUMEM_STORE;
+							break;
+						}
+						case 0x6f: { // ISWR
+							result.def(VUREG_MEMORY, dest);
+							result.use(it, VULANE_X, VUMAP_FIXED);
+							result.use(is, VULANE_X, VUMAP_FIXED, 0xff, true);
+							result.memory = VUMEM_STORE;
+							break;
+						}
+						case 0x70: { // RXOR
+							result.def(VUREG_R, VULANE_X);
+							result.use(VUREG_R, VULANE_X, VUMAP_FIXED);
+							result.use(VUREG_VF + fs, fsf, VUMAP_FIXED);
+							break;
+						}
+						case 0x7c: efu(VULANE_XYZ); break; // ERLENG
+					}
+					break;
+				}
+			}
+			break;
+		}
+	}
+	return result;
+}
+
+enum VuFmacOperand
+{
+	VUFMAC_FT,   // Full vector
+	VUFMAC_BC,   // Broadcast lane of ft
+	VUFMAC_I,
+	VUFMAC_Q
+};
+
+static VuInsn decode_upper(u32 insn)
+{
+	VuInsn result;
+	u8 ft = (insn >> 16) & 0x1f;
+	u8 fs = (insn >> 11) & 0x1f;
+	u8 fd = (insn >> 6) & 0x1f;
+	u8 dest = vu_dest_lanes(insn);
+	u8 bc = 1 << (insn & 3);
+
+	auto fmac = [&](bool to_acc, VuFmacOperand second, bool accumulate, bool sets_flags) {
+		result.def(to_acc ? VUREG_ACC : VUREG_VF + fd, dest);
+		if(sets_flags) {
+			result.def(VUREG_MAC, VULANE_X);
+			result.def(VUREG_STATUS, VULANE_X);
+		}
+		result.use(VUREG_VF + fs, dest);
+		switch(second) {
+			case VUFMAC_FT: result.use(VUREG_VF + ft, dest); break;
+			case VUFMAC_BC: result.use(VUREG_VF + ft, bc, VUMAP_FIXED); break;
+			case VUFMAC_I: result.use(VUREG_I, VULANE_X, VUMAP_FIXED); break;
+			case VUFMAC_Q: result.use(VUREG_Q, VULANE_X, VUMAP_FIXED); break;
+		}
+		if(accumulate) {
+			result.use(VUREG_ACC, dest);
+		}
+		result.is_float = true;
+	};
+	auto convert = [&]() {
+		result.def(VUREG_VF + ft, dest);
+		result.use(VUREG_VF + fs, dest);
+	};
+
+	u32 opcode = insn & 0x3f;
+	if(opcode < 0x3c) {
+		switch(opcode) {
+			case 0x00: case 0x01: case 0x02: case 0x03: fmac(false, VUFMAC_BC, false, true); break; // ADDbc
+			case 0x04: case 0x05: case 0x06: case 0x07: fmac(false, VUFMAC_BC, false, true); break; // SUBbc
+			case 0x08: case 0x09: case 0x0a: case 0x0b: fmac(false, VUFMAC_BC, true, true); break; // MADDbc
+			case 0x0c: case 0x0d: case 0x0e: case 0x0f: fmac(false, VUFMAC_BC, true, true); break; // MSUBbc
+			case 0x10: case 0x11: case 0x12: case 0x13: fmac(false, VUFMAC_BC, false, false); break; // MAXbc
+			case 0x14: case 0x15: case 0x16: case 0x17: fmac(false, VUFMAC_BC, false, false); break; // MINIbc
+			case 0x18: case 0x19: case 0x1a: case 0x1b: fmac(false, VUFMAC_BC, false, true); break; // MULbc
+			case 0x1c: fmac(false, VUFMAC_Q, false, true); break; // MULq
+			case 0x1d: fmac(false, VUFMAC_I, false, false); break; // MAXi
+			case 0x1e: fmac(false, VUFMAC_I, false, true); break; // MULi
+			case 0x1f: fmac(false, VUFMAC_I, false, false); break; // MINIi
+			case 0x20: fmac(false, VUFMAC_Q, false, true); break; // ADDq
+			case 0x21: fmac(false, VUFMAC_Q, true, true); break; // MADDq
+			case 0x22: fmac(false, VUFMAC_I, false, true); break; // ADDi
+			case 0x23: fmac(false, VUFMAC_I, true, true); break; // MADDi
+			case 0x24: fmac(false, VUFMAC_Q, false, true); break; // SUBq
+			case 0x25: fmac(false, VUFMAC_Q, true, true); break; // MSUBq
+			case 0x26: fmac(false, VUFMAC_I, false, true); break; // SUBi
+			case 0x27: fmac(false, VUFMAC_I, true, true); break; // MSUBi
+			case 0x28: fmac(false, VUFMAC_FT, false, true); break; // ADD
+			case 0x29: fmac(false, VUFMAC_FT, true, true); break; // MADD
+			case 0x2a: fmac(false, VUFMAC_FT, false, true); break; // MUL
+			case 0x2b: fmac(false, VUFMAC_FT, false, false); break; // MAX
+			case 0x2c: fmac(false, VUFMAC_FT, false, true); break; // SUB
+			case 0x2d: fmac(false, VUFMAC_FT, true, true); break; // MSUB
+			case 0x2e: { // OPMSUB
+				result.def(VUREG_VF + fd, dest);
+				result.def(VUREG_MAC, VULANE_X);
+				result.def(VUREG_STATUS, VULANE_X);
+				result.use(VUREG_VF + fs, VULANE_XYZ, VUMAP_FIXED);
+				result.use(VUREG_VF + ft, VULANE_XYZ, VUMAP_FIXED);
+				result.use(VUREG_ACC, dest);
+				result.is_float = true;
+				break;
+			}
+			case 0x2f: fmac(false, VUFMAC_FT, false, false); break; // MINI
+		}
+		return result;
+	}
+
+	switch(((insn & 3) << 5) | ((insn >> 6) & 0x1f)) {
+		case 0x00: case 0x20: case 0x40: case 0x60: fmac(true, VUFMAC_BC, false, true); break; // ADDAbc
+		case 0x01: case 0x21: case 0x41: case 0x61: fmac(true, VUFMAC_BC, false, true); break; // SUBAbc
+		case 0x02: case 0x22: case 0x42: case 0x62: fmac(true, VUFMAC_BC, true, true); break; // MADDAbc
+		case 0x03: case 0x23: case 0x43: case 0x63: fmac(true, VUFMAC_BC, true, true); break; // MSUBAbc
+		case 0x04: case 0x24: case 0x44: case 0x64: convert(); result.is_float = true; break; // ITOFx
+		case 0x05: case 0x25: case 0x45: case 0x65: convert(); break; // FTOIx
+		case 0x06: case 0x26: case 0x46: case 0x66: fmac(true, VUFMAC_BC, false, true); break; // MULAbc
+		case 0x07: fmac(true, VUFMAC_Q, false, true); break; // MULAq
+		case 0x27: convert(); result.is_float = true; break; // ABS
+		case 0x47: fmac(true, VUFMAC_I, false, true); break; // MULAi
+		case 0x67: { // CLIP
+			result.def(VUREG_CLIP, VULANE_X);
+			result.use(VUREG_VF + fs, VULANE_XYZ, VUMAP_FIXED);
+			result.use(VUREG_VF + ft, VULANE_W, VUMAP_FIXED);
+			result.use(VUREG_CLIP, VULANE_X, VUMAP_FIXED);
+			break;
+		}
+		case 0x08: fmac(true, VUFMAC_Q, false, true); break; // ADDAq
+		case 0x28: fmac(true, VUFMAC_Q, true, true); break; // MADDAq
+		case 0x48: fmac(true, VUFMAC_I, false, true); break; // ADDAi
+		case 0x68: fmac(true, VUFMAC_I, true, true); break; // MADDAi
+		case 0x09: fmac(true, VUFMAC_Q, false, true); break; // SUBAq
+		case 0x29: fmac(true, VUFMAC_Q, true, true); break; // MSUBAq
+		case 0x49: fmac(true, VUFMAC_I, false, true); break; // SUBAi
+		case 0x69: fmac(true, VUFMAC_I, true, true); break; // MSUBAi
+		case 0x0a: fmac(true, VUFMAC_FT, false, true); break; // ADDA
+		case 0x2a: fmac(true, VUFMAC_FT, true, true); break; // MADDA
+		case 0x4a: fmac(true, VUFMAC_FT, false, true); break; // MULA
+		case 0x0b: fmac(true, VUFMAC_FT, false, true); break; // SUBA
+		case 0x2b: fmac(true, VUFMAC_FT, true, true); break; // MSUBA
+		case 0x4b: { // OPMULA
+			result.def(VUREG_ACC, dest);
+			result.def(VUREG_MAC, VULANE_X);
+			result.def(VUREG_STATUS, VULANE_X);
+			result.use(VUREG_VF + fs, VULANE_XYZ, VUMAP_FIXED);
+			result.use(VUREG_VF + ft, VULANE_XYZ, VUMAP_FIXED);
+			result.is_float = true;
+			break;
+		}
+	}
+	return result;
+}
+
+static VuInsnPair decode_instruction_pair(const u8 *instruction)
+{
+	u32 lower = *(const u32*) &instruction[0];
+	u32 upper = *(const u32*) &instruction[4];
+
+	VuInsnPair pair;
+	pair.upper = decode_upper(upper);
+	if(upper & (1u << 31)) {
+		// I bit: The lower word is loaded into the I register.
+		pair.lower.def(VUREG_I, VULANE_X);
+		pair.lower.is_float = true; // The constant is always a float.
+	} else {
+		pair.lower = decode_lower(lower);
+	}
+	pair.is_end = (upper & (1u << 30)) != 0;
+	return pair;
+}
+
+#endif
@@ -18,13 +18,22 @@
 
 #include <map>
 #include <array>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <fstream>
 #include <iomanip>
 #include <sstream>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
 #include <functional>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -37,18 +46,115 @@
 #include "pcsx2defs.h"
 #include "pcsx2disassemble.h"
 #include "gif.h"
+#include "vuops.h"
+#include "query.h"
 #include "fonts.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define VUTRACE_SSE2
+	#include <emmintrin.h>
+#endif
+
+#ifdef __linux__
+	#include <unistd.h>
+#endif
+
 static const int INSN_PAIR_SIZE = 8;
+static const std::size_t MAX_VALUE_SEARCH_HITS = 100000;
+static const std::size_t MAX_SLICE_STEPS = 1000000;
+static const std::size_t SLICE_LOOKBACK = 64; // How far back to look for long latency producers e.g. DIV.
+static const std::size_t MAX_LOOP_COLUMNS = 32;
+static const int PROFILE_SKETCH_SIZE = 4;
+static const std::size_t MAX_ANOMALIES = 100000;
+static const u32 MIN_STRIDE_RUN = 3; // Accesses needed before a stride is reported.
+static const std::size_t SPARKLINE_BUCKET = 64; // Snapshots per bucket in the finest level of a sparkline pyramid.
+static const std::size_t MAX_HEATMAP_COLUMNS = 4096; // In the finest level.
+static const int HEATMAP_TILE_WIDTH = 256;
+static const int HEATMAP_ROWS = VU1_MEMSIZE / 0x10;
+static const std::size_t TIMELINE_BUCKET = 16; // Snapshots per bucket in the finest level of the timeline pyramid.
+static const u32 MAX_TIMELINE_BLOCKS_PER_COLUMN = 16;
+
+// Register lanes and memory words are numbered so that they can share one set
+// of change lists. Register lanes come first, in 'r' packet order.
+static const u32 MEMORY_LOCATION = VUREG_COUNT * 4;
+static const u32 LOCATION_COUNT = MEMORY_LOCATION + VU1_MEMSIZE / 4;
 static int row_size_imgui = 4;
 static int row_size = 16;
-static int tick_rate = 1;
+static const int REDRAW_FRAMES = 3; // Frames drawn after each event so the UI can settle.
+static const double TEXT_CURSOR_TIMEOUT = 0.25; // Redraw interval while a text field is being edited.
+static const double TOOLTIP_TIMEOUT = 0.5; // Longer than ImGui's hover delays for SetItemTooltip.
+static std::atomic<int> redraw_frames(REDRAW_FRAMES);
+static const double MAX_PLAYBACK_STEP = 0.1; // Seconds of playback advanced per frame at most.
 static bool show_as_hex = false;
+static bool show_sparklines = false;
 static float font_size = 16.0f;
 static bool use_default_font = false;
 static bool require_font_update = false;
 static ImFontConfig default_font_cfg = ImFontConfig();
 
+enum TimerId
+{
+	TIMER_FRAME,
+	TIMER_PARSE,
+	TIMER_DISASSEMBLE,
+	TIMER_INDEX,
+	TIMER_GS_DECODE,
+	TIMER_QUERY,
+	TIMER_SEARCH,
+	TIMER_NAVIGATION,
+	TIMER_ANALYSIS,
+	TIMER_SNAPSHOTS_WINDOW,
+	TIMER_REGISTERS_WINDOW,
+	TIMER_MEMORY_WINDOW,
+	TIMER_DISASSEMBLY_WINDOW,
+	TIMER_GS_PACKET_WINDOW,
+	TIMER_VALUE_SEARCH_WINDOW,
+	TIMER_SLICE_WINDOW,
+	TIMER_TAINT_WINDOW,
+	TIMER_LOOP_TABLE_WINDOW,
+	TIMER_ANOMALIES_WINDOW,
+	TIMER_STATE_HASHES_WINDOW,
+	TIMER_CALL_STACK_WINDOW,
+	TIMER_HEATMAP_WINDOW,
+	TIMER_TIMELINE_WINDOW,
+	TIMER_PERFORMANCE_WINDOW,
+	TIMER_COUNT
+};
+
+static const char *TIMER_NAMES[TIMER_COUNT] = {
+	"frame", "parse", "disassemble", "index", "gs decode", "query", "search", "navigation", "analysis",
+	"snapshots", "registers", "memory", "disassembly", "gs packet", "value search", "slice", "taint",
+	"loop table", "anomalies", "state hashes", "call stack", "heatmap", "timeline", "performance"
+};
+
+static const int TIMER_HISTORY_SIZE = 240; // Frames.
+
+// Timings are inclusive of any nested timers. Only the main thread should
+// start timers.
+struct TimerStats
+{
+	double total_ms = 0.0;
+	std::size_t calls = 0;
+	double frame_ms = 0.0; // Accumulated since the start of the current frame.
+	float history[TIMER_HISTORY_SIZE] = {};
+};
+
+static TimerStats timers[TIMER_COUNT];
+static int timer_history_index = 0;
+
+struct ScopedTimer
+{
+	TimerId id;
+	std::chrono::steady_clock::time_point begin;
+	ScopedTimer(TimerId i) : id(i), begin(std::chrono::steady_clock::now()) {}
+	~ScopedTimer() {
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+		timers[id].total_ms += ms;
+		timers[id].frame_ms += ms;
+		timers[id].calls++;
+	}
+};
+
 struct Snapshot
 {
 	VURegs registers = {};
@@ -58,6 +164,34 @@ struct Snapshot
 	u32 read_size = 0;
 	u32 write_addr = 0;
 	u32 write_size = 0;
+	u64 hash = 0; // Of the registers and memory, see hash_word.
+};
+
+struct OperandProfile
+{
+	u8 reg;
+	u8 lanes;
+	bool is_def;
+	double min = INFINITY;
+	double max = -INFINITY;
+	std::array<u32, 4> distinct[PROFILE_SKETCH_SIZE]; // The first few distinct values seen, with unused lanes zeroed.
+	int distinct_count = 0; // PROFILE_SKETCH_SIZE + 1 if there were more.
+};
+
+// Tracks the addresses accessed by a single load/store instruction as runs of
+// constant stride, keeping only the longest run so memory use is bounded.
+struct AccessPattern
+{
+	std::size_t accesses = 0;
+	bool is_store = false;
+	u32 last_address = 0;
+	u32 run_base = 0;
+	s32 run_stride = 0;
+	u32 run_length = 0;
+	u32 base = 0;
+	s32 stride = 0;
+	u32 count = 0;
+	std::size_t runs = 0; // Runs of at least MIN_STRIDE_RUN accesses.
 };
 
 struct Instruction
@@ -66,7 +200,274 @@ struct Instruction
 	std::map<u32, std::size_t> branch_to_times;
 	std::map<u32, std::size_t> branch_from_times;
 	std::size_t times_executed = 0;
+	std::vector<std::size_t> executions; // Indices of the snapshots where the PC points to this instruction.
 	std::string disassembly;
+	std::string branches; // Where execution came from and went to, with counts.
+	VuInsnPair ops;
+	std::vector<OperandProfile> operands; // Registers read and written, with the range of values seen.
+	u64 profile_word = 0; // The instruction pair the operands were profiled for.
+	AccessPattern access;
+	std::string profile;
+};
+
+// A group of strided accesses with the same stride over the same range,
+// e.g. the loads of the position, normal and texture coordinate of each vertex.
+struct MemoryBuffer
+{
+	u32 base;
+	u32 stride;
+	u32 count;
+	bool is_output;
+	std::vector<std::pair<u32, u32>> fields; // Offsets into each element, and the instructions that access them.
+};
+
+struct ValueSearchHit
+{
+	std::size_t first_snapshot;
+	std::size_t last_snapshot;
+	bool in_memory;
+	u32 location; // Byte address if in_memory, otherwise a VF register index (32 is ACC).
+	u32 lane; // Index of the first matched lane within the register.
+};
+
+struct ValueSearch
+{
+	bool is_open = false;
+	std::string values;
+	float tolerance = 0.001f;
+	bool search_registers = true;
+	bool search_memory = true;
+	std::string error;
+	std::vector<ValueSearchHit> hits;
+	bool truncated = false;
+};
+
+struct QueryTab
+{
+	int id;
+	bool is_open = true;
+	std::string name; // Optional label shown instead of the expression.
+	std::string text;
+	Query query;
+	std::vector<std::size_t> results; // Sorted indices of matching snapshots.
+};
+
+struct Slice
+{
+	bool is_open = false;
+	bool follow_addresses = false;
+	std::string description;
+	std::size_t snapshot = 0;
+	std::vector<u32> start;
+	std::vector<std::size_t> instructions; // Sorted indices of the snapshots where contributing instructions were executed.
+	std::vector<std::pair<u32, std::size_t>> inputs; // Locations read but not produced by an instruction, and when they last changed.
+	std::bitset<VU1_PROGSIZE / INSN_PAIR_SIZE> program;
+	bool truncated = false;
+};
+
+struct TaintOutput
+{
+	u32 address;
+	std::size_t first_snapshot; // Snapshots where the first and last stores of tainted data were recorded.
+	std::size_t last_snapshot;
+	std::size_t stores = 0;
+};
+
+struct TaintKick
+{
+	std::size_t snapshot;
+	u32 address;
+	u32 size;
+	u32 tainted_quadwords;
+};
+
+struct Taint
+{
+	bool is_open = false;
+	std::string begin_text;
+	std::string end_text;
+	std::string error;
+	std::size_t snapshot = 0;
+	u32 begin = 0;
+	u32 end = 0;
+	std::vector<TaintOutput> outputs;
+	std::vector<TaintKick> kicks;
+};
+
+struct LoopTable
+{
+	bool is_open = false;
+	u32 head = 0;
+	u32 variants_head = UINT32_MAX; // The loop head that the variants below were computed for.
+	std::vector<u32> variants; // Which path each iteration took, most common first.
+	u32 variant_count = 0;
+	std::string columns_text = "vi01; vi02; vf01.x; vf01.y; vf01.z; vf01.w";
+	std::vector<std::string> column_names;
+	std::vector<Query> columns;
+	std::string error;
+};
+
+enum AnomalyType
+{
+	ANOMALY_NAN,
+	ANOMALY_INF,
+	ANOMALY_DENORMAL,
+	ANOMALY_CLAMPED,
+	ANOMALY_TYPE_COUNT
+};
+
+// Masks of the lanes of a quadword that would be NaN, infinity, denormal or
+// the largest finite float (which is what PCSX2 clamps to) if read as IEEE
+// floats. The real VU has none of these special cases.
+struct LaneAnomalies
+{
+	u32 masks[ANOMALY_TYPE_COUNT];
+};
+
+struct Anomaly
+{
+	std::size_t snapshot; // Where the value first appears.
+	std::size_t producer; // Snapshot of the instruction that wrote it, or SIZE_MAX.
+	u32 location;
+	u32 value;
+	AnomalyType type;
+};
+
+struct AnomalyScan
+{
+	bool is_open = false;
+	bool include_memory = false;
+	bool has_run = false;
+	std::vector<Anomaly> anomalies;
+	std::size_t counts[ANOMALY_TYPE_COUNT] = {};
+	bool truncated = false;
+};
+
+// A subroutine call made with BAL/JALR, and the JR that returned from it.
+struct CallFrame
+{
+	std::size_t call; // Snapshot of the call instruction.
+	std::size_t return_snapshot; // First snapshot back in the caller, or SIZE_MAX if it never returned.
+	u32 parent;
+	u32 depth;
+	u32 target;
+	u32 return_address;
+};
+
+struct BasicBlock
+{
+	u32 begin;
+	u32 end; // Exclusive.
+};
+
+// The executed path is stored as the sequence of basic blocks entered.
+struct PathEntry
+{
+	u32 block;
+	u32 snapshot;
+};
+
+// The last GS packet decoded, along with the range of snapshots over which
+// the memory it was decoded from stays the same.
+struct GsPacketCache
+{
+	bool valid = false;
+	u32 address = 0;
+	std::size_t first_snapshot = 0;
+	std::size_t last_snapshot = 0;
+	GsPacket packet;
+};
+
+// The minimum and maximum of some value over buckets of snapshots, then pairs
+// of those buckets and so on, so that a strip can be drawn for any range of
+// snapshots in O(pixels).
+template <typename T>
+struct MinMaxPyramid
+{
+	std::size_t bucket_size = 1; // Snapshots per bucket in the finest level.
+	std::vector<std::vector<std::pair<T, T>>> levels;
+};
+
+// The range of a register lane over buckets of SPARKLINE_BUCKET snapshots.
+typedef MinMaxPyramid<float> SparklinePyramid;
+
+// The part of a zoomable strip that is in view, in the strip's own units.
+struct StripView
+{
+	double begin = 0.0;
+	double end = 0.0; // If not greater than begin, everything is shown.
+};
+
+// Memory accesses over time, with one row per quadword and one column per
+// bucket of snapshots. Built on a background thread as RGBA texels (red for
+// stores, green for loads, blue for VIF writes), with each coarser level made
+// by taking the maximum of pairs of columns, then uploaded in tiles.
+struct Heatmap
+{
+	bool is_open = false;
+	std::thread worker;
+	std::atomic<bool> ready{false};
+	std::atomic<bool> cancel{false};
+	std::size_t bucket_size = 1; // Snapshots per column in the finest level.
+	std::size_t columns = 0; // In the finest level.
+	std::vector<std::vector<u32>> levels; // Tile after tile, each HEATMAP_ROWS rows of HEATMAP_TILE_WIDTH texels.
+	std::vector<std::vector<GLuint>> textures; // Indexed by level, then tile.
+	StripView view; // In columns of the finest level.
+	
+	~Heatmap() {
+		cancel = true;
+		if(worker.joinable()) {
+			worker.join();
+		}
+	}
+};
+
+struct Timeline
+{
+	bool is_open = false;
+	MinMaxPyramid<u16> pcs; // The lowest and highest PC executed over buckets of TIMELINE_BUCKET snapshots.
+	u32 lowest_pc = 0;
+	u32 highest_pc = 0;
+	StripView view; // In snapshots.
+};
+
+enum NavigationEvent
+{
+	EVENT_XGKICK,
+	EVENT_STORE,
+	EVENT_BRANCH_TAKEN,
+	EVENT_PROGRAM_ENTRY,
+	EVENT_COUNT
+};
+
+enum MemoryClass
+{
+	MEMCLASS_UNTOUCHED,
+	MEMCLASS_READ_ONLY,  // Loaded or kicked, but never stored to by the VU.
+	MEMCLASS_KICKED,     // Stored to by the VU, then sent to the GS.
+	MEMCLASS_SCRATCH,    // Stored to and loaded back by the VU, but never sent to the GS.
+	MEMCLASS_WRITE_ONLY, // Stored to by the VU, but never loaded back or sent to the GS.
+	MEMCLASS_COUNT
+};
+
+struct QuadwordUsage
+{
+	u32 loads = 0;
+	u32 stores = 0;
+	u32 kicks = 0;
+	u32 uploads = 0; // Words written by VIF.
+	MemoryClass type = MEMCLASS_UNTOUCHED;
+};
+
+struct StateHashes
+{
+	bool is_open = false;
+	std::unordered_map<u64, std::size_t> first_seen; // Built when the window is first opened.
+	std::string compare_path;
+	std::string compare_error;
+	std::vector<u64> compare_hashes;
+	std::size_t first_difference = SIZE_MAX;
+	std::size_t difference_count = 0;
 };
 
 struct AppState
@@ -74,13 +475,51 @@ struct AppState
 	std::size_t current_snapshot = 0;
 	std::vector<Snapshot> snapshots;
 	bool snapshots_scroll_to = false;
+	int playback_direction = 0; // 1 when playing forwards, -1 when playing backwards, 0 when paused.
+	float playback_speed = 1000.f; // Snapshots per second.
+	double playback_position = 0.0;
+	double playback_time = 0.0; // When playback was last advanced.
 	bool disassembly_scroll_to = false;
 	std::vector<Instruction> instructions;
 	std::string disassembly_highlight;
+	std::string highlight_evaluated; // The highlight text that the fields below were computed for.
+	std::bitset<VU1_PROGSIZE / INSN_PAIR_SIZE> highlighted_instructions;
+	std::vector<std::size_t> highlighted_snapshots;
 	std::string trace_file_path;
 	bool comments_loaded = false;
 	std::string comment_file_path;
 	std::array<std::string, VU1_PROGSIZE / INSN_PAIR_SIZE> comments;
+	s32 memory_scroll_to = -1;
+	std::vector<u16> memory_change_masks; // Bytes of each quadword that changed since the last snapshot.
+	std::size_t memory_masks_snapshot = SIZE_MAX;
+	ValueSearch value_search;
+	std::string query_text;
+	std::string query_error;
+	std::vector<QueryTab> query_tabs;
+	int next_query_id = 0;
+	std::vector<std::size_t> events[EVENT_COUNT]; // Sorted indices of the snapshots where each kind of event happens.
+	std::vector<std::vector<u32>> changes; // Sorted indices of the snapshots at which each location changed value.
+	std::vector<std::pair<u32, u32>> external_writes; // Snapshot indices and locations of memory changes not made by a store e.g. VIF unpacks.
+	Slice slice;
+	Taint taint;
+	std::vector<u32> loop_heads; // Targets of backward branches.
+	LoopTable loop_table;
+	AnomalyScan anomaly_scan;
+	std::vector<MemoryBuffer> buffers;
+	std::vector<BasicBlock> blocks;
+	std::vector<u32> block_of; // Indexed by instruction.
+	std::vector<PathEntry> path;
+	std::vector<CallFrame> frames; // Frame 0 is the top level of a microprogram.
+	std::vector<u32> frame_of; // The innermost frame of each snapshot.
+	bool call_stack_open = false;
+	bool performance_open = false;
+	StateHashes state_hashes;
+	std::vector<QuadwordUsage> memory_usage; // Indexed by quadword.
+	GsPacketCache gs_packet_cache;
+	std::unordered_map<u32, SparklinePyramid> sparklines; // Built when first drawn.
+	StripView sparkline_view; // Range of snapshots shown by the sparklines.
+	Heatmap heatmap;
+	Timeline timeline;
 };
 
 struct MessageBoxState
@@ -94,23 +533,99 @@ static MessageBoxState comment_box;
 static MessageBoxState save_to_file;
 static MessageBoxState find_bytes;
 static MessageBoxState go_to_box;
+static MessageBoxState export_memory_map_box;
+static MessageBoxState load_queries_box;
+static MessageBoxState save_queries_box;
 
 void update_gui(AppState &app);
+void update_highlight(AppState &app);
 void snapshots_window(AppState &app);
 void registers_window(AppState &app);
+void register_slice_menu(AppState &app, u8 reg, const std::string &name);
+void sparkline(AppState &app, const char *id, const u32 *locations, int location_count);
+template <typename T> void build_coarser_levels(MinMaxPyramid<T> &pyramid);
+template <typename T> void include_pyramid_range(const MinMaxPyramid<T> &pyramid, std::size_t begin, std::size_t end, std::pair<T, T> &range);
+void fit_strip_view(StripView &view, double total);
+bool strip_input(StripView &view, double total, double min_size, ImVec2 min, ImVec2 size, double &position);
+const SparklinePyramid &get_sparkline_pyramid(AppState &app, u32 location);
+std::pair<float, float> sparkline_range(AppState &app, u32 location, std::size_t begin, std::size_t end);
+float location_value(Snapshot &snapshot, u32 location);
 void memory_window(AppState &app);
+void update_memory_change_masks(AppState &app);
 void disassembly_window(AppState &app);
 void gs_packet_window(AppState &app);
+const GsPacket &get_gs_packet(AppState &app, u32 address);
+void value_search_window(AppState &app);
+void value_search_hits_list(AppState &app);
+void search_values(AppState &app, const float *pattern, int pattern_size);
+u32 compare_lanes(const u8 *data, const float *pattern, float tolerance);
+void parallel_for(std::size_t count, std::function<void(std::size_t begin, std::size_t end)> func);
 bool walk_until_pc_equal(AppState &app, u32 target_pc, int step); // Add step to the current snapshot index until pc == target_pc, otherwise do nothing.
 void walk_until_mem_access(AppState &app, u32 address); // Add 1 to the current snapshot index until a snapshot reads from/writes to address, otherwise do nothing.
-void parse_trace(AppState &app, std::string trace_file_path);
+bool walk_until_query_match(AppState &app, const QueryTab &tab, int step); // Move to the next (step > 0) or previous query match, otherwise do nothing.
+bool walk_until_event(AppState &app, const std::vector<std::size_t> &events, int step); // Same as above, for any sorted list of snapshots.
+VuInsnPair snapshot_ops(const AppState &app, std::size_t snapshot_index); // Decode the instruction about to be executed from the snapshot's own program.
+void build_event_index(AppState &app);
+void toggle_playback(AppState &app, int direction);
+void update_playback(AppState &app, double time);
+void add_query_tab(AppState &app, const std::string &text);
+void run_query(AppState &app, QueryTab &tab);
+void load_query_file(AppState &app, const std::string &path);
+void save_query_file(AppState &app, const std::string &path);
+QueryContext query_context(AppState &app, std::size_t snapshot_index);
+void slice_window(AppState &app);
+void compute_slice(AppState &app, std::size_t snapshot, const std::vector<u32> &start, const std::string &description);
+bool find_producer(AppState &app, u32 location, std::size_t changed_at, std::size_t &producer, VuInsn &insn, int &def);
+std::vector<u32> locations_of(u8 reg, u32 address = 0);
+std::string location_name(u32 location);
+u32 *location_pointer(Snapshot &snapshot, u32 location);
+void record_change(AppState &app, u32 location);
+void taint_window(AppState &app);
+void loop_table_window(AppState &app);
+void compile_loop_columns(AppState &app);
+void anomalies_window(AppState &app);
+void scan_anomalies(AppState &app);
+LaneAnomalies classify_lanes(const u8 *data);
+u32 changed_lanes(const u8 *lhs, const u8 *rhs);
+void record_access(AccessPattern &pattern, u32 address);
+void end_access_run(AccessPattern &pattern);
+std::string format_access(const AccessPattern &pattern);
+void find_buffers(AppState &app);
+const MemoryBuffer *buffer_at(AppState &app, u32 address);
+u64 hash_word(u32 location, u32 value);
+void state_hashes_window(AppState &app);
+void compare_trace(AppState &app);
+void classify_memory(AppState &app);
+void export_memory_map(AppState &app, const std::string &path);
+const char *memory_class_name(MemoryClass type);
+void build_path(AppState &app);
+std::size_t path_index_at(AppState &app, std::size_t snapshot);
+u32 pc_at(AppState &app, std::size_t snapshot);
+void find_loop_variants(AppState &app);
+void build_call_index(AppState &app);
+bool step_over(AppState &app, int step);
+bool step_out(AppState &app, int step);
+void call_stack_window(AppState &app);
+void heatmap_window(AppState &app);
+void build_heatmap(AppState &app);
+void upload_heatmap(Heatmap &heatmap);
+void timeline_window(AppState &app);
+void build_timeline(AppState &app);
+std::pair<u16, u16> timeline_range(AppState &app, std::size_t begin, std::size_t end);
+ImU32 timeline_block_colour(u32 block);
+void init_profile(Instruction &instruction);
+void profile_instruction(Instruction &instruction, Snapshot &before, Snapshot &after);
+std::string format_profile(const Instruction &instruction);
+std::string format_branches(AppState &app, std::size_t index);
+void run_taint(AppState &app);
+bool parse_trace(AppState &app, std::string trace_file_path, std::vector<u64> *hashes_only = nullptr, std::string *error = nullptr);
 void parse_comment_file(AppState &app, std::string comment_file_path);
 void save_comment_file(AppState &app);
 std::string disassemble(u8 *program, u32 address);
 bool is_xgkick(u32 lower);
 void init_gui(GLFWwindow **window);
 void update_font();
-void main_menu_bar();
+void main_menu_bar(AppState &app);
 void handle_shortcuts();
 void begin_docking();
 void create_dock_layout(GLFWwindow *window);
@@ -119,6 +634,10 @@ bool prompt(MessageBoxState &state, const char *title);
 std::vector<u8> decode_hex(const std::string &in);
 std::string to_hex(size_t n);
 size_t from_hex(const std::string& in);
+void request_redraw(); // Thread safe.
+void end_frame_timers();
+void performance_window(AppState &app);
+void dump_timers(AppState &app, const std::string &path);
 
 int main(int argc, char **argv)
 {
@@ -140,12 +659,42 @@ int main(int argc, char **argv)
 	
 	ImGuiContext &g = *GImGui;
 
+	bool tooltip_pending = true;
 	while(!glfwWindowShouldClose(window)) {
 		if (require_font_update) {
 			update_font();
 		}
 		
-		glfwPollEvents();
+		// Only draw frames when something has happened. While an item is
+		// active a timeout is used so the text cursor still blinks. Tooltips
+		// shown with SetItemTooltip only appear once the mouse has been still
+		// for a moment, so after the mouse stops over an item wait for that
+		// delay once before blocking. Timeouts only draw a single frame.
+		if(redraw_frames > 0) {
+			redraw_frames--;
+			glfwPollEvents();
+		} else if(ImGui::IsAnyItemActive()) {
+			double wait_begin = glfwGetTime();
+			glfwWaitEventsTimeout(TEXT_CURSOR_TIMEOUT);
+			if(glfwGetTime() - wait_begin < TEXT_CURSOR_TIMEOUT) {
+				redraw_frames = REDRAW_FRAMES;
+				tooltip_pending = true;
+			}
+		} else if(tooltip_pending && ImGui::IsAnyItemHovered()) {
+			double wait_begin = glfwGetTime();
+			glfwWaitEventsTimeout(TOOLTIP_TIMEOUT);
+			if(glfwGetTime() - wait_begin < TOOLTIP_TIMEOUT) {
+				redraw_frames = REDRAW_FRAMES;
+			} else {
+				tooltip_pending = false;
+			}
+		} else {
+			glfwWaitEvents();
+			redraw_frames = REDRAW_FRAMES;
+			tooltip_pending = true;
+		}
+		std::size_t last_snapshot = app.current_snapshot;
+		std::chrono::steady_clock::time_point frame_begin = std::chrono::steady_clock::now();
 
 		ImGui_ImplOpenGL3_NewFrame();
 		ImGui_ImplGlfw_NewFrame();
@@ -170,9 +719,32 @@ int main(int argc, char **argv)
 			if(ImGui::IsKeyPressed(ImGuiKey_D)) {
 				walk_until_pc_equal(app, pc, 1);
 			}
+			
+			ImGuiIO &io = ImGui::GetIO();
+			if(ImGui::IsKeyPressed(ImGuiKey_E) && !io.KeyCtrl) {
+				step_over(app, io.KeyShift ? -1 : 1);
+			}
+			if(ImGui::IsKeyPressed(ImGuiKey_R) && !io.KeyCtrl) {
+				step_out(app, io.KeyShift ? -1 : 1);
+			}
+			
+			static const ImGuiKey event_keys[EVENT_COUNT] = {ImGuiKey_K, ImGuiKey_M, ImGuiKey_B, ImGuiKey_N};
+			for(int event = 0; event < EVENT_COUNT; event++) {
+				if(ImGui::IsKeyPressed(event_keys[event]) && !io.KeyCtrl) {
+					walk_until_event(app, app.events[event], io.KeyShift ? -1 : 1);
+				}
+			}
+			
+			if(ImGui::IsKeyPressed(ImGuiKey_F3)) {
+				app.performance_open = !app.performance_open;
+			}
+			if(ImGui::IsKeyPressed(ImGuiKey_Space, false)) {
+				toggle_playback(app, io.KeyShift ? -1 : 1);
+			}
 		}
+		update_playback(app, glfwGetTime());
 		
-		main_menu_bar();
+		main_menu_bar(app);
 
 		begin_docking();
 		update_gui(app);
@@ -182,6 +754,10 @@ int main(int argc, char **argv)
 			is_first_frame = false;
 		}
 		ImGui::End(); // docking
+		
+		if(app.current_snapshot != last_snapshot || require_font_update) {
+			redraw_frames = REDRAW_FRAMES;
+		}
 
 		ImGui::Render();
 		glfwMakeContextCurrent(window);
@@ -192,6 +768,11 @@ int main(int argc, char **argv)
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		
+		timers[TIMER_FRAME].frame_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame_begin).count();
+		timers[TIMER_FRAME].total_ms += timers[TIMER_FRAME].frame_ms;
+		timers[TIMER_FRAME].calls++;
+		end_frame_timers();
 
 		glfwMakeContextCurrent(window);
 		glfwSwapBuffers(window);
@@ -205,17 +786,189 @@ int main(int argc, char **argv)
 	glfwTerminate();
 }
 
+void request_redraw()
+{
+	redraw_frames = REDRAW_FRAMES;
+	glfwPostEmptyEvent();
+}
+
+void end_frame_timers()
+{
+	for(TimerStats &stats : timers) {
+		stats.history[timer_history_index] = (float) stats.frame_ms;
+		stats.frame_ms = 0.0;
+	}
+	timer_history_index = (timer_history_index + 1) % TIMER_HISTORY_SIZE;
+}
+
+void performance_window(AppState &app)
+{
+	ScopedTimer timer(TIMER_PERFORMANCE_WINDOW);
+	
+	static MessageBoxState dump_box;
+	if(prompt(dump_box, "Dump Timers")) {
+		dump_timers(app, dump_box.text);
+	}
+	
+	// The main memory users, plus the resident set size where available.
+	std::size_t change_bytes = 0;
+	for(const std::vector<u32> &changes : app.changes) {
+		change_bytes += changes.capacity() * sizeof(u32);
+	}
+	ImGui::Text("Snapshots: %lu (%.1f MiB), change lists: %.1f MiB",
+		app.snapshots.size(), app.snapshots.size() * sizeof(Snapshot) / (1024.0 * 1024.0), change_bytes / (1024.0 * 1024.0));
+#ifdef __linux__
+	static std::size_t resident_pages = 0;
+	if(timer_history_index % 60 == 0) {
+		FILE *statm = fopen("/proc/self/statm", "r");
+		if(statm) {
+			std::size_t total_pages;
+			if(fscanf(statm, "%lu %lu", &total_pages, &resident_pages) != 2) {
+				resident_pages = 0;
+			}
+			fclose(statm);
+		}
+	}
+	ImGui::Text("Resident: %.1f MiB", resident_pages * (double) sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0));
+#endif
+	if(ImGui::Button("Dump to File")) {
+		dump_box.is_open = true;
+	}
+	
+	if(ImGui::BeginTable("timers", 6, ImGuiTableFlags_SizingStretchProp | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_BordersInnerH)) {
+		ImGui::TableSetupColumn("Timer");
+		ImGui::TableSetupColumn("Last Frame (ms)");
+		ImGui::TableSetupColumn("Max (ms)");
+		ImGui::TableSetupColumn("Calls");
+		ImGui::TableSetupColumn("Total (ms)");
+		ImGui::TableSetupColumn("History");
+		ImGui::TableHeadersRow();
+		int last = (timer_history_index + TIMER_HISTORY_SIZE - 1) % TIMER_HISTORY_SIZE;
+		for(int i = 0; i < TIMER_COUNT; i++) {
+			const TimerStats &stats = timers[i];
+			float max_ms = *std::max_element(stats.history, stats.history + TIMER_HISTORY_SIZE);
+			ImGui::TableNextRow();
+			ImGui::TableSetColumnIndex(0);
+			ImGui::Text("%s", TIMER_NAMES[i]);
+			ImGui::TableSetColumnIndex(1);
+			ImGui::Text("%.3f", stats.history[last]);
+			ImGui::TableSetColumnIndex(2);
+			ImGui::Text("%.3f", max_ms);
+			ImGui::TableSetColumnIndex(3);
+			ImGui::Text("%lu", stats.calls);
+			ImGui::TableSetColumnIndex(4);
+			ImGui::Text("%.1f", stats.total_ms);
+			ImGui::TableSetColumnIndex(5);
+			ImGui::PushID(i);
+			ImGui::PlotHistogram("##history", stats.history, TIMER_HISTORY_SIZE, timer_history_index,
+				nullptr, 0.f, std::max(max_ms, 1.f), ImVec2(-1, ImGui::GetTextLineHeight()));
+			ImGui::PopID();
+		}
+		ImGui::EndTable();
+	}
+}
+
+void dump_timers(AppState &app, const std::string &path)
+{
+	FILE *file = fopen(path.c_str(), "w");
+	if(!file) {
+		fprintf(stderr, "Failed to open %s for writing.\n", path.c_str());
+		return;
+	}
+	fprintf(file, "# %s: %lu snapshots\n", app.trace_file_path.c_str(), app.snapshots.size());
+	fprintf(file, "# timer calls total_ms mean_frame_ms max_frame_ms\n");
+	for(int i = 0; i < TIMER_COUNT; i++) {
+		const TimerStats &stats = timers[i];
+		float sum = 0.f;
+		float max_ms = 0.f;
+		for(float ms : stats.history) {
+			sum += ms;
+			max_ms = std::max(max_ms, ms);
+		}
+		fprintf(file, "%s,%lu,%.3f,%.3f,%.3f\n", TIMER_NAMES[i], stats.calls, stats.total_ms, sum / TIMER_HISTORY_SIZE, max_ms);
+	}
+	fclose(file);
+}
+
 void update_gui(AppState &app)
 {
+	update_highlight(app);
+	
 	if(ImGui::Begin("Snapshots"))   snapshots_window(app);   ImGui::End();
 	if(ImGui::Begin("Registers"))   registers_window(app);   ImGui::End();
 	if(ImGui::Begin("Memory"))      memory_window(app);      ImGui::End();
 	if(ImGui::Begin("Disassembly")) disassembly_window(app); ImGui::End();
 	if(ImGui::Begin("GS Packet"))   gs_packet_window(app);   ImGui::End();
+	if(app.value_search.is_open) {
+		if(ImGui::Begin("Value Search", &app.value_search.is_open)) value_search_window(app);
+		ImGui::End();
+	}
+	if(app.slice.is_open) {
+		if(ImGui::Begin("Dataflow", &app.slice.is_open)) slice_window(app);
+		ImGui::End();
+	}
+	if(app.taint.is_open) {
+		if(ImGui::Begin("Taint", &app.taint.is_open)) taint_window(app);
+		ImGui::End();
+	}
+	if(app.loop_table.is_open) {
+		if(ImGui::Begin("Loop Iterations", &app.loop_table.is_open)) loop_table_window(app);
+		ImGui::End();
+	}
+	if(app.anomaly_scan.is_open) {
+		if(ImGui::Begin("Anomalies", &app.anomaly_scan.is_open)) anomalies_window(app);
+		ImGui::End();
+	}
+	if(app.call_stack_open) {
+		if(ImGui::Begin("Call Stack", &app.call_stack_open)) call_stack_window(app);
+		ImGui::End();
+	}
+	if(app.state_hashes.is_open) {
+		if(ImGui::Begin("State Hashes", &app.state_hashes.is_open)) state_hashes_window(app);
+		ImGui::End();
+	}
+	if(app.heatmap.is_open) {
+		if(ImGui::Begin("Memory Heatmap", &app.heatmap.is_open)) heatmap_window(app);
+		ImGui::End();
+	}
+	if(app.timeline.is_open) {
+		if(ImGui::Begin("Timeline", &app.timeline.is_open)) timeline_window(app);
+		ImGui::End();
+	}
+	if(app.performance_open) {
+		if(ImGui::Begin("Performance", &app.performance_open)) performance_window(app);
+		ImGui::End();
+	}
+}
+
+void update_highlight(AppState &app)
+{
+	if(app.disassembly_highlight == app.highlight_evaluated) {
+		return;
+	}
+	app.highlight_evaluated = app.disassembly_highlight;
+	
+	// Test each instruction once, then project the result onto the snapshots
+	// using the list of executions stored for each instruction.
+	app.highlighted_instructions.reset();
+	app.highlighted_snapshots.clear();
+	if(app.disassembly_highlight.empty()) {
+		return;
+	}
+	for(std::size_t i = 0; i < app.instructions.size(); i++) {
+		Instruction &instruction = app.instructions[i];
+		if(instruction.disassembly.find(app.disassembly_highlight) != std::string::npos) {
+			app.highlighted_instructions[i] = true;
+			app.highlighted_snapshots.insert(app.highlighted_snapshots.end(),
+				instruction.executions.begin(), instruction.executions.end());
+		}
+	}
+	std::sort(app.highlighted_snapshots.begin(), app.highlighted_snapshots.end());
 }
 
 void snapshots_window(AppState &app)
 {
+	ScopedTimer timer(TIMER_SNAPSHOTS_WINDOW);
 	
 	ImGui::AlignTextToFramePadding();
 	ImGui::Text("Iter:");
@@ -228,87 +981,161 @@ void snapshots_window(AppState &app)
 	if(ImGui::Button(" > ")) {
 		walk_until_pc_equal(app, pc, 1);
 	}
+	ImGui::SameLine();
+	if(ImGui::Button(app.playback_direction == -1 ? "Pause##reverse" : "<< Play")) {
+		toggle_playback(app, -1);
+	}
+	ImGui::SameLine();
+	if(ImGui::Button(app.playback_direction == 1 ? "Pause##forward" : "Play >>")) {
+		toggle_playback(app, 1);
+	}
+	ImGui::SameLine();
+	ImGui::PushItemWidth(-1);
+	ImGui::SliderFloat("##speed", &app.playback_speed, 1.f, 100000.f, "%.0f snapshots/s", ImGuiSliderFlags_Logarithmic);
+	ImGui::PopItemWidth();
+	
+	ImGui::PushItemWidth(-1);
+	int scrub = (int) app.current_snapshot;
+	if(ImGui::SliderInt("##scrub", &scrub, 0, (int) app.snapshots.size() - 1, "Snapshot %d")) {
+		app.current_snapshot = scrub;
+		app.playback_position = scrub;
+		app.snapshots_scroll_to = true;
+		app.disassembly_scroll_to = true;
+	}
+	ImGui::PopItemWidth();
+	
+	ImGui::PushItemWidth(ImGui::GetWindowWidth() * .75f);
+	bool add_query = ImGui::InputTextWithHint("##query", "pc == 0x1a8 && vi03 > 4", &app.query_text, ImGuiInputTextFlags_EnterReturnsTrue);
+	ImGui::PopItemWidth();
+	ImGui::SameLine();
+	add_query |= ImGui::Button("Add Query");
+	if(add_query) {
+		add_query_tab(app, app.query_text);
+	}
+	
+	if(prompt(load_queries_box, "Load Query Tabs")) {
+		load_query_file(app, load_queries_box.text);
+	}
+	if(prompt(save_queries_box, "Save Query Tabs")) {
+		save_query_file(app, save_queries_box.text);
+	}
+	if(!app.query_error.empty()) {
+		ImGui::TextColored(ImVec4(1.f, 0.5f, 0.5f, 1.f), "%s", app.query_error.c_str());
+	}
+	
+	app.query_tabs.erase(std::remove_if(app.query_tabs.begin(), app.query_tabs.end(),
+		[](const QueryTab &tab) { return !tab.is_open; }), app.query_tabs.end());
 	
-	std::function<bool(Snapshot &)> filter;
+	// Every tab other than All lists a precomputed, sorted set of snapshots so
+	// nothing has to be evaluated per frame.
+	const std::vector<std::size_t> *rows = nullptr; // If set, only these snapshots are listed.
+	bool show_search_hits = false;
 	
 	if(ImGui::BeginTabBar("tabs")) {
 		if(ImGui::BeginTabItem("All")) {
-			filter = [&](Snapshot &snapshot) { return true; };
 			ImGui::EndTabItem();
 		}
 		if(ImGui::BeginTabItem("XGKICK")) {
-			filter = [&](Snapshot &snapshot) {
-				u32 pc = snapshot.registers.VI[TPC].UL;
-				u32 lower = *(u32*) &snapshot.program[pc];
-				return is_xgkick(lower);
-			};
+			rows = &app.events[EVENT_XGKICK];
 			ImGui::EndTabItem();
 		}
 		if(ImGui::BeginTabItem("Highlighted")) {
-			filter = [&](Snapshot &snapshot) {
-				std::string disassembly = disassemble(&snapshot.program[snapshot.registers.VI[TPC].SL], snapshot.registers.VI[TPC].SL);
-				bool is_highlighted =
-					app.disassembly_highlight.size() > 0 &&
-					disassembly.find(app.disassembly_highlight) != std::string::npos;
-				return is_highlighted;
-			};
+			rows = &app.highlighted_snapshots;
 			ImGui::EndTabItem();
 		}
+		if(ImGui::BeginTabItem("Search")) {
+			show_search_hits = true;
+			ImGui::EndTabItem();
+		}
+		for(QueryTab &tab : app.query_tabs) {
+			std::string label = (tab.name.empty() ? tab.text : tab.name) + "###query" + std::to_string(tab.id);
+			if(ImGui::BeginTabItem(label.c_str(), &tab.is_open)) {
+				rows = &tab.results;
+				ImGui::AlignTextToFramePadding();
+				ImGui::Text("%lu matches", tab.results.size());
+				ImGui::SameLine();
+				if(ImGui::Button("Prev##query")) {
+					walk_until_query_match(app, tab, -1);
+				}
+				ImGui::SameLine();
+				if(ImGui::Button("Next##query")) {
+					walk_until_query_match(app, tab, 1);
+				}
+				ImGui::EndTabItem();
+			}
+		}
 		ImGui::EndTabBar();
 	}
 	
+	if(show_search_hits) {
+		value_search_hits_list(app);
+		return;
+	}
+	
 	ImVec2 size = ImGui::GetContentRegionAvail();
 	ImGui::PushItemWidth(-1);
 	if(ImGui::BeginListBox("##snapshots", size)) {
-		for(std::size_t i = 0; i < app.snapshots.size(); i++) {
-			Snapshot& snap = app.snapshots[i];
-			Snapshot next_snap;
-			if(i < app.snapshots.size() - 1) {
-				next_snap = app.snapshots[i + 1];
-			}
-			bool is_selected = i == app.current_snapshot;
-			
-			if(!filter(snap)) {
-				continue;
-			}
-			
-			std::stringstream ss;
-			ss << i;
-			if(next_snap.read_size > 0) {
-				ss << " READ 0x" << std::hex << next_snap.read_addr;
-			} else if(next_snap.write_size > 0) {
-				ss << " WRITE 0x" << std::hex << next_snap.write_addr;
-			}
-			
-			u32 pc = snap.registers.VI[TPC].UL;
-			std::string disassembly = disassemble(&snap.program[pc], pc);
-			
-			bool is_highlighted =
-			app.disassembly_highlight.size() > 0 &&
-				disassembly.find(app.disassembly_highlight) != std::string::npos;
+		std::size_t row_count = rows ? rows->size() : app.snapshots.size();
 		
-			if(is_highlighted) {
-				ImGui::PushStyleColor(ImGuiCol_Text, ImColor(255, 255, 0).Value);
-			}
-			if(ImGui::Selectable(ss.str().c_str(), is_selected)) {
-				app.current_snapshot = i;
-				app.disassembly_scroll_to = true;
-			}
-			if(is_highlighted) {
-				ImGui::PopStyleColor();
+		// Only the visible rows are laid out. The row of the current snapshot
+		// is included as well when it needs to be scrolled to.
+		ImGuiListClipper clipper;
+		clipper.Begin(row_count);
+		if(app.snapshots_scroll_to) {
+			std::size_t selected_row = app.current_snapshot;
+			if(rows) {
+				selected_row = std::lower_bound(rows->begin(), rows->end(), app.current_snapshot) - rows->begin();
 			}
-			
-			if(app.snapshots_scroll_to && is_selected) {
-				ImGui::SetScrollHereY(0.5);
+			if(selected_row < row_count) {
+				clipper.IncludeItemByIndex(selected_row);
+			} else {
 				app.snapshots_scroll_to = false;
 			}
 		}
+		char label[64];
+		while(clipper.Step()) {
+			for(int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+				std::size_t i = rows ? (*rows)[row] : row;
+				Snapshot &snap = app.snapshots[i];
+				bool is_selected = i == app.current_snapshot;
+				
+				// Memory accesses are recorded in the snapshot after the
+				// instruction that performed them.
+				Snapshot *next_snap = i + 1 < app.snapshots.size() ? &app.snapshots[i + 1] : nullptr;
+				if(next_snap && next_snap->read_size > 0) {
+					snprintf(label, sizeof(label), "%lu READ 0x%x", i, next_snap->read_addr);
+				} else if(next_snap && next_snap->write_size > 0) {
+					snprintf(label, sizeof(label), "%lu WRITE 0x%x", i, next_snap->write_addr);
+				} else {
+					snprintf(label, sizeof(label), "%lu", i);
+				}
+				
+				u32 pc = snap.registers.VI[TPC].UL;
+				bool is_highlighted = app.highlighted_instructions[pc / INSN_PAIR_SIZE];
+				if(is_highlighted) {
+					ImGui::PushStyleColor(ImGuiCol_Text, ImColor(255, 255, 0).Value);
+				}
+				if(ImGui::Selectable(label, is_selected)) {
+					app.current_snapshot = i;
+					app.disassembly_scroll_to = true;
+				}
+				if(is_highlighted) {
+					ImGui::PopStyleColor();
+				}
+				
+				if(app.snapshots_scroll_to && is_selected) {
+					ImGui::SetScrollHereY(0.5);
+					app.snapshots_scroll_to = false;
+				}
+			}
+		}
 		ImGui::EndListBox();
 	}
 	ImGui::PopItemWidth();
 }
 
 void registers_window(AppState &app) {
+	ScopedTimer timer(TIMER_REGISTERS_WINDOW);
 	Snapshot &current = app.snapshots[app.current_snapshot];
 	VURegs &regs = current.registers;
 	
@@ -323,7 +1150,10 @@ void registers_window(AppState &app) {
 			"FBRST", "VPU-STAT", "c2c30", "CMSAR1",
 	};
 	
-	ImGui::BeginTable("Registers", 2, ImGuiTableFlags_SizingStretchProp | ImGuiTableFlags_BordersInnerV |
+	// With sparklines enabled, each register is followed by a column showing
+	// its value over the trace.
+	int vi_column = show_sparklines ? 2 : 1;
+	ImGui::BeginTable("Registers", show_sparklines ? 4 : 2, ImGuiTableFlags_SizingStretchProp | ImGuiTableFlags_BordersInnerV |
 										   ImGuiTableFlags_BordersInnerH | ImGuiTableFlags_Resizable);
 
 	for (int i = 0; i < 32; i++) {
@@ -331,6 +1161,7 @@ void registers_window(AppState &app) {
 		ImGui::TableNextRow();
 		ImGui::TableSetColumnIndex(0);
 
+		ImGui::PushID(i);
 		if (show_as_hex) {
 			ImGui::Text("vf%02d = %08x %08x %08x %08x",
 						i, value.UL[0], value.UL[1], value.UL[2], value.UL[3]);
@@ -338,12 +1169,39 @@ void registers_window(AppState &app) {
 			ImGui::Text("vf%02d = %.4f %.4f %.4f %.4f",
 						i, value.F[0], value.F[1], value.F[2], value.F[3]);
 		}
+		if(ImGui::BeginPopupContextItem("vf")) {
+			char name[8];
+			snprintf(name, sizeof(name), "vf%02d", i);
+			register_slice_menu(app, VUREG_VF + i, name);
+			ImGui::EndPopup();
+		}
+		
+		if(show_sparklines) {
+			ImGui::TableSetColumnIndex(1);
+			u32 lanes[4];
+			for(u32 lane = 0; lane < 4; lane++) {
+				lanes[lane] = (VUREG_VF + i) * 4 + lane;
+			}
+			sparkline(app, "vf_history", lanes, 4);
+		}
 
-		ImGui::TableSetColumnIndex(1);
+		ImGui::TableSetColumnIndex(vi_column);
 
 		ImGui::Text("%s = 0x%x = %hd", integer_register_names[i], regs.VI[i].UL, regs.VI[i].UL);
-	}
-
+		if(i < 22 && ImGui::BeginPopupContextItem("vi")) {
+			register_slice_menu(app, VUREG_VI + i, integer_register_names[i]);
+			ImGui::EndPopup();
+		}
+		
+		// The TPC register isn't recorded in the change lists.
+		if(show_sparklines && i != TPC) {
+			ImGui::TableSetColumnIndex(3);
+			u32 location = (VUREG_VI + i) * 4;
+			sparkline(app, "vi_history", &location, 1);
+		}
+		ImGui::PopID();
+	}
+
 	ImGui::TableNextRow();
 	ImGui::TableSetColumnIndex(0);
 	if (show_as_hex) {
@@ -353,19 +1211,256 @@ void registers_window(AppState &app) {
 		ImGui::Text("ACC = %.4f %.4f %.4f %.4f",
 					regs.ACC.F[0], regs.ACC.F[1], regs.ACC.F[2], regs.ACC.F[3]);
 	}
+	if(ImGui::BeginPopupContextItem("acc")) {
+		register_slice_menu(app, VUREG_ACC, "ACC");
+		ImGui::EndPopup();
+	}
+	if(show_sparklines) {
+		ImGui::TableSetColumnIndex(1);
+		u32 lanes[4] = {VUREG_ACC * 4, VUREG_ACC * 4 + 1, VUREG_ACC * 4 + 2, VUREG_ACC * 4 + 3};
+		sparkline(app, "acc_history", lanes, 4);
+	}
 
 	ImGui::EndTable();
 }
 
+void register_slice_menu(AppState &app, u8 reg, const std::string &name)
+{
+	if(ImGui::MenuItem("Slice")) {
+		compute_slice(app, app.current_snapshot, locations_of(reg), name);
+	}
+	if(!vu_register_is_vector(reg)) {
+		return;
+	}
+	// Slicing a single lane leaves out the instructions that only produced
+	// the other lanes.
+	for(u32 lane = 0; lane < 4; lane++) {
+		std::string lane_name = location_name(reg * 4 + lane);
+		if(ImGui::MenuItem(("Slice " + lane_name).c_str())) {
+			compute_slice(app, app.current_snapshot, {reg * 4 + lane}, lane_name);
+		}
+	}
+}
+
+void sparkline(AppState &app, const char *id, const u32 *locations, int location_count)
+{
+	static const ImU32 lane_colours[4] = {
+		IM_COL32(255, 96, 96, 255),
+		IM_COL32(96, 255, 96, 255),
+		IM_COL32(96, 160, 255, 255),
+		IM_COL32(224, 224, 224, 255)
+	};
+	
+	fit_strip_view(app.sparkline_view, (double) app.snapshots.size());
+	std::size_t begin = (std::size_t) app.sparkline_view.begin;
+	std::size_t end = (std::size_t) app.sparkline_view.end;
+	
+	ImVec2 min = ImGui::GetCursorScreenPos();
+	ImVec2 size(std::max(ImGui::GetContentRegionAvail().x, 16.f), ImGui::GetTextLineHeight());
+	ImGui::InvisibleButton(id, size);
+	ImVec2 max(min.x + size.x, min.y + size.y);
+	int width = (int) size.x;
+	
+	ImDrawList *dl = ImGui::GetWindowDrawList();
+	std::vector<std::pair<float, float>> columns(width);
+	for(int i = 0; i < location_count; i++) {
+		// Sample each pixel column first so the lane can be scaled to fit.
+		float lowest = INFINITY;
+		float highest = -INFINITY;
+		for(int x = 0; x < width; x++) {
+			std::size_t column_begin = begin + (end - begin) * x / width;
+			std::size_t column_end = std::max(begin + (end - begin) * (x + 1) / width, column_begin + 1);
+			columns[x] = sparkline_range(app, locations[i], column_begin, std::min(column_end, end));
+			lowest = std::min(lowest, columns[x].first);
+			highest = std::max(highest, columns[x].second);
+		}
+		if(lowest > highest) {
+			continue; // No finite values.
+		}
+		float scale = highest > lowest ? (size.y - 1.f) / (highest - lowest) : 0.f;
+		for(int x = 0; x < width; x++) {
+			if(columns[x].first > columns[x].second) {
+				continue;
+			}
+			float top = max.y - 1.f - (columns[x].second - lowest) * scale;
+			float bottom = max.y - 1.f - (columns[x].first - lowest) * scale;
+			dl->AddLine(ImVec2(min.x + x + .5f, top), ImVec2(min.x + x + .5f, bottom + 1.f), lane_colours[i % 4]);
+		}
+	}
+	
+	if(app.current_snapshot >= begin && app.current_snapshot < end) {
+		float x = min.x + (float) (app.current_snapshot - begin) * size.x / (end - begin);
+		dl->AddLine(ImVec2(x, min.y), ImVec2(x, max.y), IM_COL32(255, 255, 0, 160));
+	}
+	
+	// Hover to inspect and click to jump.
+	double position;
+	if(strip_input(app.sparkline_view, (double) app.snapshots.size(), 16.0, min, size, position)) {
+		std::size_t snapshot = std::min((std::size_t) position, end - 1);
+		std::string tooltip = "Snapshot " + std::to_string(snapshot);
+		for(int i = 0; i < location_count; i++) {
+			char value[64];
+			snprintf(value, sizeof(value), "\n%s = %g", location_name(locations[i]).c_str(), location_value(app.snapshots[snapshot], locations[i]));
+			tooltip += value;
+		}
+		ImGui::SetTooltip("%s", tooltip.c_str());
+		
+		if(ImGui::IsItemClicked(ImGuiMouseButton_Left)) {
+			app.current_snapshot = snapshot;
+			app.snapshots_scroll_to = true;
+			app.disassembly_scroll_to = true;
+		}
+	}
+}
+
+template <typename T>
+void build_coarser_levels(MinMaxPyramid<T> &pyramid)
+{
+	while(pyramid.levels.back().size() > 1) {
+		const std::vector<std::pair<T, T>> &lower = pyramid.levels.back();
+		std::vector<std::pair<T, T>> upper((lower.size() + 1) / 2);
+		for(std::size_t i = 0; i < upper.size(); i++) {
+			upper[i] = lower[i * 2];
+			if(i * 2 + 1 < lower.size()) {
+				upper[i].first = std::min(upper[i].first, lower[i * 2 + 1].first);
+				upper[i].second = std::max(upper[i].second, lower[i * 2 + 1].second);
+			}
+		}
+		pyramid.levels.emplace_back(std::move(upper));
+	}
+}
+
+template <typename T>
+void include_pyramid_range(const MinMaxPyramid<T> &pyramid, std::size_t begin, std::size_t end, std::pair<T, T> &range)
+{
+	// Use the coarsest level with at least two buckets in the range.
+	std::size_t level = 0;
+	while(level + 1 < pyramid.levels.size() && (end - begin) >= (pyramid.bucket_size << (level + 2))) {
+		level++;
+	}
+	std::size_t bucket_size = pyramid.bucket_size << level;
+	const std::vector<std::pair<T, T>> &buckets = pyramid.levels[level];
+	for(std::size_t i = begin / bucket_size; i <= (end - 1) / bucket_size && i < buckets.size(); i++) {
+		range.first = std::min(range.first, buckets[i].first);
+		range.second = std::max(range.second, buckets[i].second);
+	}
+}
+
+void fit_strip_view(StripView &view, double total)
+{
+	if(view.end <= view.begin || view.end > total) {
+		view.begin = 0.0;
+		view.end = total;
+	}
+}
+
+// Handles Ctrl+scroll to zoom around the mouse and right click to zoom back
+// out for the last item, a strip showing part of a range from 0 to total.
+// Returns true and sets position to the point under the mouse if hovered.
+bool strip_input(StripView &view, double total, double min_size, ImVec2 min, ImVec2 size, double &position)
+{
+	if(!ImGui::IsItemHovered()) {
+		return false;
+	}
+	double fraction = std::min(std::max((ImGui::GetMousePos().x - min.x) / size.x, 0.f), 1.f);
+	position = view.begin + (view.end - view.begin) * fraction;
+	
+	if(ImGui::IsItemClicked(ImGuiMouseButton_Right)) {
+		view.begin = 0.0;
+		view.end = total;
+	}
+	ImGuiIO &io = ImGui::GetIO();
+	if(io.KeyCtrl && io.MouseWheel != 0.f) {
+		double new_size = std::max((view.end - view.begin) * (io.MouseWheel > 0.f ? 0.5 : 2.0), min_size);
+		new_size = std::min(new_size, total);
+		double new_begin = std::min(std::max(position - new_size * fraction, 0.0), total - new_size);
+		view.begin = new_begin;
+		view.end = new_begin + new_size;
+	}
+	return true;
+}
+
+const SparklinePyramid &get_sparkline_pyramid(AppState &app, u32 location)
+{
+	auto iter = app.sparklines.find(location);
+	if(iter != app.sparklines.end()) {
+		return iter->second;
+	}
+	SparklinePyramid &pyramid = app.sparklines[location];
+	pyramid.bucket_size = SPARKLINE_BUCKET;
+	
+	// Each bucket starts with the value at its first snapshot, then takes in
+	// the value after each change inside it.
+	std::size_t bucket_count = (app.snapshots.size() + SPARKLINE_BUCKET - 1) / SPARKLINE_BUCKET;
+	const std::vector<u32> &changes = app.changes[location];
+	std::vector<u32>::const_iterator change = changes.begin();
+	pyramid.levels.emplace_back(bucket_count);
+	std::vector<std::pair<float, float>> &finest = pyramid.levels.back();
+	for(std::size_t i = 0; i < bucket_count; i++) {
+		std::pair<float, float> &bucket = finest[i];
+		bucket = {INFINITY, -INFINITY};
+		std::size_t bucket_begin = i * SPARKLINE_BUCKET;
+		std::size_t bucket_end = std::min(bucket_begin + SPARKLINE_BUCKET, app.snapshots.size());
+		float first_value = location_value(app.snapshots[bucket_begin], location);
+		if(isfinite(first_value)) {
+			bucket = {first_value, first_value};
+		}
+		for(; change != changes.end() && *change <= bucket_begin; change++);
+		for(; change != changes.end() && *change < bucket_end; change++) {
+			float value = location_value(app.snapshots[*change], location);
+			if(isfinite(value)) {
+				bucket = {std::min(bucket.first, value), std::max(bucket.second, value)};
+			}
+		}
+	}
+	build_coarser_levels(pyramid);
+	return pyramid;
+}
+
+std::pair<float, float> sparkline_range(AppState &app, u32 location, std::size_t begin, std::size_t end)
+{
+	std::pair<float, float> range = {INFINITY, -INFINITY};
+	const auto include = [&](float value) {
+		if(isfinite(value)) {
+			range = {std::min(range.first, value), std::max(range.second, value)};
+		}
+	};
+	
+	// Short ranges are read straight from the snapshots.
+	if(end - begin < SPARKLINE_BUCKET * 2) {
+		include(location_value(app.snapshots[begin], location));
+		const std::vector<u32> &changes = app.changes[location];
+		for(auto change = std::upper_bound(changes.begin(), changes.end(), begin); change != changes.end() && *change < end; change++) {
+			include(location_value(app.snapshots[*change], location));
+		}
+		return range;
+	}
+	
+	// Buckets without any finite values are left as (INFINITY, -INFINITY) so
+	// they don't affect the range.
+	include_pyramid_range(get_sparkline_pyramid(app, location), begin, end, range);
+	return range;
+}
+
+float location_value(Snapshot &snapshot, u32 location)
+{
+	u32 raw = *location_pointer(snapshot, location);
+	u32 reg = location / 4;
+	if(reg >= VUREG_VI && reg < VUREG_VI + 16) {
+		return (float) (s16) raw;
+	}
+	if(reg >= VUREG_VI && reg < VUREG_ACC && reg != VUREG_R && reg != VUREG_I) {
+		return (float) raw;
+	}
+	float value;
+	memcpy(&value, &raw, 4);
+	return value;
+}
+
 void memory_window(AppState &app)
 {
+	ScopedTimer timer(TIMER_MEMORY_WINDOW);
 	Snapshot &current = app.snapshots[app.current_snapshot];
-	Snapshot *last;
-	if(app.current_snapshot > 0) {
-		last = &app.snapshots[app.current_snapshot - 1];
-	} else {
-		last = &current;
-	}
 	
 	static MessageBoxState found_bytes;
 	alert(found_bytes, "Found Bytes");
@@ -395,83 +1490,191 @@ void memory_window(AppState &app)
 		}
 	}
 	
-	static std::string scroll_to_address_str;
-	s32 scroll_to_address = -1;
-
 	if(prompt(go_to_box, "Scroll To Address"))
 	{
-		scroll_to_address = strtol(go_to_box.text.c_str(), NULL, 16);
+		app.memory_scroll_to = strtol(go_to_box.text.c_str(), NULL, 16);
+	}
+	
+	if(prompt(export_memory_map_box, "Export Memory Map")) {
+		export_memory_map(app, export_memory_map_box.text);
 	}
 	
+	update_memory_change_masks(app);
+	
 	ImGui::BeginChild("rows_outer");
 	if(ImGui::BeginChild("rows")) {
 		ImDrawList *dl = ImGui::GetWindowDrawList();
 		
-		ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.f, 0.f, 0.f, 0.f));
-		ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(0, 0));
-		ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(18, 4));
+		// The bytes are drawn directly with the draw list rather than as
+		// individual widgets, and are hit tested using the mouse position.
+		const float byte_width = ImGui::CalcTextSize("00").x;
+		const float byte_spacing = 6.f;
+		const float word_spacing = 18.f;
+		const float word_width = byte_width * 4 + byte_spacing * 3;
+		const float line_height = ImGui::GetTextLineHeight() + 4.f;
+		const ImU32 unchanged_col = ImGui::GetColorU32(ImVec4(0.8f, 0.8f, 0.8f, 1.f));
+		const ImU32 changed_col = ImGui::GetColorU32(ImVec4(1.f, 0.5f, 0.5f, 1.f));
+		static const ImU32 class_colours[MEMCLASS_COUNT] = {
+			IM_COL32(0, 0, 0, 0),
+			IM_COL32(64, 96, 255, 40),
+			IM_COL32(64, 255, 96, 40),
+			IM_COL32(255, 160, 64, 40),
+			IM_COL32(255, 64, 160, 40)
+		};
+		static const char hex_digits[] = "0123456789abcdef";
+		static u32 context_address = 0;
+		bool open_context_menu = false;
 		
-		for(int i = 0; i < VU1_MEMSIZE / row_size; i++) {
-			ImGui::PushID(i);
-			
-			static ImColor row_header_col = ImColor(1.f, 1.f, 1.f);
-			std::stringstream row_header;
-			row_header << std::hex << std::setfill('0') << std::setw(5) << i * row_size;
-			ImGui::Text("%s", row_header.str().c_str());
-			ImGui::SameLine();
-			
-			for(int j = 0; j < row_size / 4; j++) {
-				ImGui::PushID(j);
-				const auto draw_byte = [&](int k) {
-					ImGui::PushID(k);
-					
-					u32 address = i * row_size + j * 4 + k;
-					u32 val = current.memory[address];
-					u32 last_val = last->memory[address];
-					std::stringstream hex;
-					if(val < 0x10) hex << "0";
-					hex << std::hex << val;
-					ImVec4 hex_col = ImVec4(0.8f, 0.8f, 0.8f, 1.f);
-					if(val != last_val) {
-						hex_col = ImVec4(1.f, 0.5f, 0.5f, 1.f);
+		ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(word_spacing, 4));
+		
+		int row_count = VU1_MEMSIZE / row_size;
+		int scroll_row = -1;
+		if(app.memory_scroll_to >= 0 && (u32) app.memory_scroll_to < VU1_MEMSIZE) {
+			scroll_row = app.memory_scroll_to / row_size;
+		}
+		ImGuiListClipper clipper;
+		clipper.Begin(row_count, line_height);
+		if(scroll_row > -1) {
+			clipper.IncludeItemByIndex(scroll_row);
+		}
+		while(clipper.Step()) {
+			for(int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+				ImGui::PushID(i);
+				
+				char row_header[16];
+				snprintf(row_header, sizeof(row_header), "%05x", i * row_size);
+				const QuadwordUsage &usage = app.memory_usage[i * row_size / 0x10];
+				if(usage.type != MEMCLASS_UNTOUCHED) {
+					ImVec2 row_min = ImGui::GetCursorScreenPos();
+					ImVec2 row_max(row_min.x + ImGui::GetContentRegionAvail().x, row_min.y + ImGui::GetTextLineHeight());
+					dl->AddRectFilled(row_min, row_max, class_colours[usage.type]);
+				}
+				
+				const MemoryBuffer *buffer = buffer_at(app, i * row_size);
+				if(buffer) {
+					ImGui::PushStyleColor(ImGuiCol_Text, buffer->is_output ? ImColor(255, 160, 64).Value : ImColor(96, 192, 255).Value);
+				}
+				ImGui::Text("%s", row_header);
+				if(buffer) {
+					ImGui::PopStyleColor();
+				}
+				if(ImGui::IsItemHovered()) {
+					std::stringstream description;
+					description << memory_class_name(usage.type) << ": " << usage.loads << " loads, " << usage.stores << " stores, "
+						<< usage.kicks << " kicks, " << usage.uploads << " VIF writes";
+					if(buffer) {
+						description << std::hex << "\n" << (buffer->is_output ? "Output" : "Input") << " buffer "
+							<< buffer->base << "-" << buffer->base + buffer->stride * buffer->count << ": "
+							<< std::dec << buffer->count << " x 0x" << std::hex << buffer->stride << " bytes";
+						for(const std::pair<u32, u32> &field : buffer->fields) {
+							description << "\n+" << field.first << " " << app.instructions[field.second / INSN_PAIR_SIZE].disassembly;
+						}
 					}
-					ImGui::PushStyleColor(ImGuiCol_Text, hex_col);
-					if(ImGui::Button(hex.str().c_str())) {
-						walk_until_mem_access(app, address);
+					ImGui::SetTooltip("%s", description.str().c_str());
+				}
+				ImGui::SameLine();
+				
+				ImVec2 origin = ImGui::GetCursorScreenPos();
+				int words = row_size / 4;
+				ImGui::InvisibleButton("bytes", ImVec2(words * word_width + (words - 1) * word_spacing, ImGui::GetTextLineHeight()));
+				
+				// Work out which byte the mouse is over, if any.
+				s32 hovered = -1;
+				if(ImGui::IsItemHovered()) {
+					float x = ImGui::GetMousePos().x - origin.x;
+					int word = (int) (x / (word_width + word_spacing));
+					float word_x = x - word * (word_width + word_spacing);
+					int byte = (int) (word_x / (byte_width + byte_spacing));
+					if(x >= 0 && word < words && byte < 4 && word_x - byte * (byte_width + byte_spacing) < byte_width) {
+						hovered = i * row_size + word * 4 + byte;
 					}
-					ImGui::SameLine();
-					ImGui::PopStyleColor();
-					
-					if(address == scroll_to_address) {
-						ImGui::SetScrollHereY(0.5);
+				}
+				
+				for(int j = 0; j < words; j++) {
+					u32 word_address = i * row_size + j * 4;
+					u32 changed = app.memory_change_masks[word_address / 0x10] >> (word_address & 0xf);
+					for(int k = 0; k < 4; k++) {
+						u8 val = current.memory[word_address + k];
+						char hex[2] = {hex_digits[val >> 4], hex_digits[val & 0xf]};
+						ImVec2 pos(origin.x + j * (word_width + word_spacing) + k * (byte_width + byte_spacing), origin.y);
+						if((s32) (word_address + k) == hovered) {
+							dl->AddRectFilled(pos, ImVec2(pos.x + byte_width, pos.y + ImGui::GetTextLineHeight()), ImGui::GetColorU32(ImGuiCol_ButtonHovered));
+						}
+						dl->AddText(pos, (changed >> k) & 1 ? changed_col : unchanged_col, hex, hex + 2);
 					}
-					
-					ImGui::PopID(); // k
-				};
+				}
 				
-				ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(6, 4));
-				draw_byte(0);
-				draw_byte(1);
-				draw_byte(2);
-				ImGui::PopStyleVar();
-				draw_byte(3);
-				ImGui::PopID(); // j
-			}
-			ImGui::NewLine();
-			
-			ImGui::PopID(); // i
+				if(hovered > -1) {
+					if(ImGui::IsItemClicked(ImGuiMouseButton_Left)) {
+						walk_until_mem_access(app, hovered);
+					}
+					if(ImGui::IsMouseClicked(ImGuiMouseButton_Right)) {
+						context_address = hovered;
+						open_context_menu = true;
+					}
+				}
+				
+				if(i == scroll_row) {
+					ImGui::SetScrollHereY(0.5);
+				}
+				
+				ImGui::PopID(); // i
+			}
 		}
 		
-		ImGui::PopStyleColor();
-		ImGui::PopStyleVar();
 		ImGui::PopStyleVar();
+		
+		if(open_context_menu) {
+			ImGui::OpenPopup("byte");
+		}
+		if(ImGui::BeginPopup("byte")) {
+			if(ImGui::MenuItem("Slice Quadword")) {
+				compute_slice(app, app.current_snapshot, locations_of(VUREG_MEMORY, context_address), "quadword " + to_hex(context_address & ~0xf));
+			}
+			if(ImGui::MenuItem("Taint From Here")) {
+				app.taint.is_open = true;
+				app.taint.begin_text = to_hex(context_address & ~0xf);
+				app.taint.end_text = to_hex(context_address | 0xf);
+			}
+			ImGui::EndPopup();
+		}
+		
+		app.memory_scroll_to = -1;
 	}
 	ImGui::EndChild();
 	ImGui::EndChild();
 }
 
+void update_memory_change_masks(AppState &app)
+{
+	if(app.memory_masks_snapshot == app.current_snapshot) {
+		return;
+	}
+	app.memory_masks_snapshot = app.current_snapshot;
+	
+	Snapshot &current = app.snapshots[app.current_snapshot];
+	Snapshot &last = app.snapshots[app.current_snapshot > 0 ? app.current_snapshot - 1 : 0];
+	app.memory_change_masks.resize(VU1_MEMSIZE / 0x10);
+	for(u32 i = 0; i < VU1_MEMSIZE / 0x10; i++) {
+#ifdef VUTRACE_SSE2
+		__m128i a = _mm_loadu_si128((const __m128i*) &current.memory[i * 0x10]);
+		__m128i b = _mm_loadu_si128((const __m128i*) &last.memory[i * 0x10]);
+		app.memory_change_masks[i] = ~_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) & 0xffff;
+#else
+		u16 mask = 0;
+		for(u32 j = 0; j < 0x10; j++) {
+			if(current.memory[i * 0x10 + j] != last.memory[i * 0x10 + j]) {
+				mask |= 1 << j;
+			}
+		}
+		app.memory_change_masks[i] = mask;
+#endif
+	}
+}
+
 void disassembly_window(AppState &app)
 {
+	ScopedTimer timer(TIMER_DISASSEMBLY_WINDOW);
 	Snapshot &current = app.snapshots[app.current_snapshot];
 	
 	ImGui::PushItemWidth(ImGui::GetWindowWidth() - (ImGui::GetWindowWidth() * .75f));
@@ -495,237 +1698,2430 @@ void disassembly_window(AppState &app)
 
 	ImGui::BeginChild("disasm");
 
-	ImGui::BeginTable("Instructions", 2, ImGuiTableFlags_SizingStretchProp | ImGuiTableFlags_BordersInnerV |
+	ImGui::BeginTable("Instructions", 4, ImGuiTableFlags_SizingStretchProp | ImGuiTableFlags_BordersInnerV |
 									  ImGuiTableFlags_BordersInnerH | ImGuiTableFlags_Resizable);
 
-	for(std::size_t i = 0; i < VU1_PROGSIZE; i += INSN_PAIR_SIZE) {
-		ImGui::TableNextRow();
-		ImGui::TableSetColumnIndex(0);
-		ImGui::PushID(i);
+	// Every row is one line high so that only the visible rows need to be
+	// submitted. The branch annotations are formatted once on startup.
+	u32 pc = current.registers.VI[TPC].UL;
+	ImGuiListClipper clipper;
+	clipper.Begin(VU1_PROGSIZE / INSN_PAIR_SIZE);
+	if(app.disassembly_scroll_to) {
+		clipper.IncludeItemByIndex(pc / INSN_PAIR_SIZE);
+	}
+	while(clipper.Step()) {
+		for(int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+			std::size_t i = row * INSN_PAIR_SIZE;
+			ImGui::TableNextRow();
+			ImGui::TableSetColumnIndex(0);
+			ImGui::PushID(i);
+
+			const Instruction &instruction = app.instructions[i / INSN_PAIR_SIZE];
+			bool is_pc = pc == i;
+			ImGuiSelectableFlags flags = instruction.is_executed ?
+										 ImGuiSelectableFlags_None :
+										 ImGuiSelectableFlags_Disabled;
+
+			bool is_highlighted = app.highlighted_instructions[i / INSN_PAIR_SIZE];
+			bool is_sliced = app.slice.is_open && app.slice.program[i / INSN_PAIR_SIZE];
+
+			if(is_highlighted) {
+				ImGui::PushStyleColor(ImGuiCol_Text, ImColor(255, 255, 0).Value);
+			} else if(is_sliced) {
+				ImGui::PushStyleColor(ImGuiCol_Text, ImColor(128, 255, 128).Value);
+			}
+			bool clicked = ImGui::Selectable(instruction.disassembly.c_str(), is_pc, flags);
+			if(is_highlighted || is_sliced) {
+				ImGui::PopStyleColor();
+			}
+
+			if(is_pc && app.disassembly_scroll_to) {
+				ImGui::SetScrollHereY(0.5);
+				app.disassembly_scroll_to = false;
+			}
+
+			if(!is_pc && clicked) {
+				bool pc_changed = false;
+				if(pc > i) {
+					pc_changed = walk_until_pc_equal(app, i, -1);
+					if(!pc_changed) {
+						pc_changed = walk_until_pc_equal(app, i, 1);
+					}
+				} else {
+					pc_changed = walk_until_pc_equal(app, i, 1);
+					if(!pc_changed) {
+						pc_changed = walk_until_pc_equal(app, i, -1);
+					}
+				}
+				if(pc_changed) {
+					app.disassembly_scroll_to = true;
+				}
+			}
+
+			ImGui::TableSetColumnIndex(1);
+			
+			ImGui::Text("%s", instruction.branches.c_str());
+			
+			ImGui::TableSetColumnIndex(2);
+			
+			ImGui::TextDisabled("%s", instruction.profile.c_str());
+			
+			ImGui::TableSetColumnIndex(3);
+			
+			if(!is_pc) {
+				ImGui::PushStyleColor(ImGuiCol_FrameBg, ImVec4(0.f, 0.f, 0.f, 0.f));
+			}
+			std::string &comment = app.comments.at(i / INSN_PAIR_SIZE);
+			ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(0, 0));
+			ImGui::PushItemWidth(-1);
+			ImGuiInputTextFlags comment_flags = app.comments_loaded ?
+												ImGuiInputTextFlags_None :
+												ImGuiInputTextFlags_ReadOnly;
+			if(ImGui::InputText("##comment", &comment, comment_flags)) {
+				save_comment_file(app);
+			}
+			ImGui::PopItemWidth();
+			ImGui::PopStyleVar();
+			if(!is_pc) {
+				ImGui::PopStyleColor();
+			}
+
+			ImGui::PopID();
+		}
+	}
 
-		Instruction instruction = app.instructions[i / INSN_PAIR_SIZE];
-		bool is_pc = current.registers.VI[TPC].UL == i;
-		ImGuiSelectableFlags flags = instruction.is_executed ?
-									 ImGuiSelectableFlags_None :
-									 ImGuiSelectableFlags_Disabled;
+	ImGui::EndTable();
+	ImGui::EndChild();
+}
 
-		std::string disassembly = instruction.disassembly; 
+void gs_packet_window(AppState &app)
+{
+	ScopedTimer timer(TIMER_GS_PACKET_WINDOW);
+	ImGui::Columns(2);
+	
+	static std::string address_hex;
+	ImGui::InputText("Address", &address_hex);
+	
+	Snapshot &snap = app.snapshots[app.current_snapshot];
+	
+	std::size_t address;
+	if(address_hex.size() == 0) {
+		u32 pc = snap.registers.VI[TPC].UL;
+		u32 lower = *(u32*) &snap.program[pc];
+		if(is_xgkick(lower)) {
+			u32 is = bit_range(lower, 11, 15);
+			address = snap.registers.VI[is].UL * 0x10;
+		} else {
+			return;
+		}
+	} else {
+		address = from_hex(address_hex);
+	}
+	
+	if(address < 0) address = 0;
+	if(address > VU1_MEMSIZE) address = VU1_MEMSIZE;
+	
+	const GsPacket &packet = get_gs_packet(app, address);
+	
+	ImGui::BeginChild("primlist");
+	
+	static std::size_t selected_primitive = 0;
+	for(std::size_t i = 0; i < packet.primitives.size(); i++) {
+		std::string label = std::to_string(i);
+		if(ImGui::Selectable(label.c_str(), i == selected_primitive)) {
+			selected_primitive = i;
+		}
+	}
+	if(selected_primitive >= packet.primitives.size()) {
+		selected_primitive = 0;
+	}
+	
+	ImGui::EndChild();
+	ImGui::NextColumn();
+	
+	if(packet.primitives.size() < 1) {
+		return;
+	}
+	const GsPrimitive &prim = packet.primitives[selected_primitive];
+	const GifTag &tag = prim.tag;
+	
+	ImGui::TextWrapped("NLOOP=%x, EOP=%x, PRE=%x, FLAG=%s, NREG=%lx\n",
+		tag.nloop, tag.eop, tag.pre, gif_flag_name(tag.flag), tag.regs.size());
+	
+	ImGui::TextWrapped("PRIM: PRIM=%s, IIP=%s, TME=%d, FGE=%d, ABE=%d, AA1=%d, FST=%s, CTXT=%s, FIX=%d",
+		gs_primitive_type_name(tag.prim.prim),
+		tag.prim.iip == GSSHADE_FLAT ? "FLAT" : "GOURAUD",
+		tag.prim.tme, tag.prim.fge, tag.prim.abe, tag.prim.aa1,
+		tag.prim.fst == GSFST_STQ ? "STQ" : "UV",
+		tag.prim.ctxt == GSCTXT_1 ? "FIRST" : "SECOND",
+		tag.prim.fix);
+	
+	
+	ImGui::TextWrapped("REGS:");
+	ImGui::SameLine();
+	for(std::size_t i = 0; i < tag.regs.size(); i++) {
+		ImGui::TextWrapped("%s", gs_register_name(tag.regs[i]));
+		ImGui::SameLine();
+	}
+	ImGui::NewLine();
+	
+	ImGui::BeginChild("data");
+	for(const GsPackedData& item : prim.packed_data) {
+		ImGui::PushID(item.source_address);
+		if(ImGui::SmallButton("Slice")) {
+			compute_slice(app, app.current_snapshot, locations_of(VUREG_MEMORY, item.source_address), "quadword " + to_hex(item.source_address));
+		}
+		ImGui::PopID();
+		ImGui::SameLine();
+		ImGui::Text("%x: %6s", item.source_address, gs_register_name(item.reg));
+		ImGui::SameLine();
+		switch(item.reg) {
+			case GSREG_AD: {
+				ImGui::Text("%s <- %lx\n", gif_ad_register_name(item.ad.addr), item.ad.data);
+				break;
+			}
+			case GSREG_XYZF2: {
+				ImGui::Text("%d %d %d F=%d ADC=%d",
+					item.xyzf2.x, item.xyzf2.y, item.xyzf2.z, item.xyzf2.f, item.xyzf2.adc);
+				break;
+			}
+			default: {
+				// Hex dump the raw data.
+				for(std::size_t i = 0; i < 0x10; i += 4) {
+					ImGui::Text("%02x%02x%02x%02x",
+						item.buffer[i + 0],
+						item.buffer[i + 1],
+						item.buffer[i + 2],
+						item.buffer[i + 3]);
+					ImGui::SameLine();
+				}
+				ImGui::NewLine();
+			}
+		}
+	}
+	ImGui::EndChild();
+}
+
+const GsPacket &get_gs_packet(AppState &app, u32 address)
+{
+	GsPacketCache &cache = app.gs_packet_cache;
+	std::size_t snapshot = app.current_snapshot;
+	if(cache.valid && cache.address == address && snapshot >= cache.first_snapshot && snapshot <= cache.last_snapshot) {
+		return cache.packet;
+	}
+	
+	Snapshot &snap = app.snapshots[snapshot];
+	cache.valid = true;
+	cache.address = address;
+	{
+		ScopedTimer timer(TIMER_GS_DECODE);
+		cache.packet = read_gs_packet(&snap.memory[address], VU1_MEMSIZE - address);
+	}
+	
+	// The packet can be reused until any of the words it was decoded from
+	// are next modified.
+	cache.first_snapshot = 0;
+	cache.last_snapshot = app.snapshots.size() - 1;
+	u32 size = gs_packet_size(&snap.memory[address], VU1_MEMSIZE - address);
+	for(u32 word = address / 4; word < (address + size) / 4; word++) {
+		const std::vector<u32> &changes = app.changes[MEMORY_LOCATION + word];
+		auto next = std::upper_bound(changes.begin(), changes.end(), snapshot);
+		if(next != changes.end()) {
+			cache.last_snapshot = std::min(cache.last_snapshot, (std::size_t) *next - 1);
+		}
+		if(next != changes.begin()) {
+			cache.first_snapshot = std::max(cache.first_snapshot, (std::size_t) *(next - 1));
+		}
+	}
+	return cache.packet;
+}
+
+void value_search_window(AppState &app)
+{
+	ScopedTimer timer(TIMER_VALUE_SEARCH_WINDOW);
+	ValueSearch &search = app.value_search;
+	
+	ImGui::InputText("Values", &search.values);
+	ImGui::SetItemTooltip("Between one and four floats, e.g. \"1.0 0.5 0.25\".\nVectors are matched against consecutive lanes.");
+	ImGui::InputFloat("Tolerance", &search.tolerance, 0.0001f, 0.01f, "%g");
+	ImGui::Checkbox("Registers", &search.search_registers);
+	ImGui::SameLine();
+	ImGui::Checkbox("Memory", &search.search_memory);
+	
+	if(ImGui::Button("Search")) {
+		float pattern[4];
+		int pattern_size = 0;
+		const char *ptr = search.values.c_str();
+		search.error = "";
+		for(;;) {
+			while(*ptr == ' ' || *ptr == ',' || *ptr == '\t') ptr++;
+			if(*ptr == '\0') {
+				break;
+			}
+			char *end;
+			float value = strtof(ptr, &end);
+			if(end == ptr) {
+				search.error = "Invalid float.";
+				break;
+			}
+			if(pattern_size >= 4) {
+				search.error = "Too many values.";
+				break;
+			}
+			pattern[pattern_size++] = value;
+			ptr = end;
+		}
+		if(search.error.empty() && pattern_size == 0) {
+			search.error = "No values entered.";
+		}
+		if(search.error.empty()) {
+			search_values(app, pattern, pattern_size);
+		}
+	}
+	
+	if(!search.error.empty()) {
+		ImGui::TextColored(ImVec4(1.f, 0.5f, 0.5f, 1.f), "%s", search.error.c_str());
+	} else {
+		ImGui::Text("%lu matches%s", search.hits.size(), search.truncated ? " (truncated)" : "");
+	}
+	ImGui::TextWrapped("Matches are listed in the Search tab of the Snapshots window.");
+}
+
+void value_search_hits_list(AppState &app)
+{
+	static const char lane_names[] = "xyzw";
+	
+	ImVec2 size = ImGui::GetContentRegionAvail();
+	ImGui::PushItemWidth(-1);
+	if(ImGui::BeginListBox("##hits", size)) {
+		for(std::size_t i = 0; i < app.value_search.hits.size(); i++) {
+			const ValueSearchHit &hit = app.value_search.hits[i];
+			
+			char label[64];
+			if(hit.in_memory) {
+				snprintf(label, sizeof(label), "%lu-%lu mem %04x", hit.first_snapshot, hit.last_snapshot, hit.location);
+			} else if(hit.location < 32) {
+				snprintf(label, sizeof(label), "%lu-%lu vf%02d.%c", hit.first_snapshot, hit.last_snapshot, hit.location, lane_names[hit.lane]);
+			} else {
+				snprintf(label, sizeof(label), "%lu-%lu ACC.%c", hit.first_snapshot, hit.last_snapshot, lane_names[hit.lane]);
+			}
+			
+			bool is_selected = app.current_snapshot >= hit.first_snapshot && app.current_snapshot <= hit.last_snapshot;
+			ImGui::PushID(i);
+			if(ImGui::Selectable(label, is_selected)) {
+				app.current_snapshot = hit.first_snapshot;
+				app.disassembly_scroll_to = true;
+				if(hit.in_memory) {
+					app.memory_scroll_to = hit.location;
+				}
+			}
+			ImGui::PopID();
+		}
+		ImGui::EndListBox();
+	}
+	ImGui::PopItemWidth();
+}
+
+bool walk_until_pc_equal(AppState &app, u32 target_pc, int step)
+{
+	ScopedTimer timer(TIMER_NAVIGATION);
+	const std::vector<std::size_t> &executions = app.instructions[target_pc / INSN_PAIR_SIZE].executions;
+	std::vector<std::size_t>::const_iterator execution;
+	if(step > 0) {
+		execution = std::upper_bound(executions.begin(), executions.end(), app.current_snapshot);
+		if(execution == executions.end()) {
+			return false;
+		}
+	} else {
+		execution = std::lower_bound(executions.begin(), executions.end(), app.current_snapshot);
+		if(execution == executions.begin()) {
+			return false;
+		}
+		execution--;
+	}
+	app.current_snapshot = *execution;
+	app.snapshots_scroll_to = true;
+	return true;
+}
+
+void walk_until_mem_access(AppState &app, u32 address)
+{
+	ScopedTimer timer(TIMER_NAVIGATION);
+	std::size_t snapshot_index = app.current_snapshot;
+	do {
+		snapshot_index = (snapshot_index + 1) % app.snapshots.size();
+		
+		Snapshot &snap = app.snapshots[snapshot_index];
+		if((snap.read_size > 0 && (snap.read_addr / 0x10 == address / 0x10)) ||
+		   (snap.write_size > 0 && (snap.write_addr / 0x10 == address / 0x10))) {
+			if(snapshot_index >= 1) {
+				app.current_snapshot = snapshot_index - 1;
+				app.snapshots_scroll_to = true;
+				app.disassembly_scroll_to = true;
+			}
+			return;
+		}
+	} while(snapshot_index != app.current_snapshot);
+}
+
+void search_values(AppState &app, const float *pattern, int pattern_size)
+{
+	ScopedTimer timer(TIMER_SEARCH);
+	ValueSearch &search = app.value_search;
+	search.hits.clear();
+	search.truncated = false;
+	
+	// Candidate locations are every 4 byte aligned word in memory where the
+	// pattern could start, followed by every lane offset of VF00-VF31 and ACC.
+	std::size_t memory_locations = search.search_memory ? VU1_MEMSIZE / 4 - pattern_size + 1 : 0;
+	int register_offsets = 4 - pattern_size + 1;
+	std::size_t register_locations = search.search_registers ? 33 * register_offsets : 0;
+	
+	// Pre-shift the pattern for each lane offset so that testing a location is
+	// a single vector compare.
+	float shifted[4][4] = {};
+	u32 needed[4] = {};
+	for(int offset = 0; offset < register_offsets; offset++) {
+		for(int i = 0; i < pattern_size; i++) {
+			shifted[offset][offset + i] = pattern[i];
+		}
+		needed[offset] = ((1 << pattern_size) - 1) << offset;
+	}
+	
+	std::mutex hits_mutex;
+	parallel_for(memory_locations + register_locations, [&](std::size_t begin, std::size_t end) {
+		// Each worker owns a range of locations and records the ranges of
+		// snapshots over which each of them matches.
+		std::vector<ValueSearchHit> hits;
+		std::vector<std::size_t> run_start(end - begin, SIZE_MAX);
+		bool truncated = false;
+		
+		auto push_hit = [&](std::size_t location, std::size_t first, std::size_t last) {
+			if(hits.size() >= MAX_VALUE_SEARCH_HITS) {
+				truncated = true;
+				return;
+			}
+			ValueSearchHit hit;
+			hit.first_snapshot = first;
+			hit.last_snapshot = last;
+			hit.in_memory = location < memory_locations;
+			if(hit.in_memory) {
+				hit.location = location * 4;
+				hit.lane = 0;
+			} else {
+				hit.location = (location - memory_locations) / register_offsets;
+				hit.lane = (location - memory_locations) % register_offsets;
+			}
+			hits.push_back(hit);
+		};
+		
+		for(std::size_t i = 0; i < app.snapshots.size(); i++) {
+			Snapshot &snap = app.snapshots[i];
+			for(std::size_t location = begin; location < end; location++) {
+				bool match;
+				if(location < memory_locations) {
+					u32 address = location * 4;
+					u32 mask;
+					if(address + 16 <= VU1_MEMSIZE) {
+						mask = compare_lanes(&snap.memory[address], shifted[0], search.tolerance);
+					} else {
+						u8 tail[16] = {};
+						memcpy(tail, &snap.memory[address], VU1_MEMSIZE - address);
+						mask = compare_lanes(tail, shifted[0], search.tolerance);
+					}
+					match = (mask & needed[0]) == needed[0];
+				} else {
+					std::size_t reg = (location - memory_locations) / register_offsets;
+					int offset = (location - memory_locations) % register_offsets;
+					VECTOR &value = reg < 32 ? snap.registers.VF[reg] : snap.registers.ACC;
+					u32 mask = compare_lanes(value.UC, shifted[offset], search.tolerance);
+					match = (mask & needed[offset]) == needed[offset];
+				}
+				
+				std::size_t &start = run_start[location - begin];
+				if(match && start == SIZE_MAX) {
+					start = i;
+				} else if(!match && start != SIZE_MAX) {
+					push_hit(location, start, i - 1);
+					start = SIZE_MAX;
+				}
+			}
+		}
+		for(std::size_t location = begin; location < end; location++) {
+			if(run_start[location - begin] != SIZE_MAX) {
+				push_hit(location, run_start[location - begin], app.snapshots.size() - 1);
+			}
+		}
+		
+		std::lock_guard<std::mutex> lock(hits_mutex);
+		search.hits.insert(search.hits.end(), hits.begin(), hits.end());
+		search.truncated |= truncated;
+	});
+	
+	std::sort(search.hits.begin(), search.hits.end(), [](const ValueSearchHit &lhs, const ValueSearchHit &rhs) {
+		if(lhs.first_snapshot != rhs.first_snapshot) return lhs.first_snapshot < rhs.first_snapshot;
+		if(lhs.in_memory != rhs.in_memory) return !lhs.in_memory;
+		return lhs.location < rhs.location;
+	});
+	if(search.hits.size() > MAX_VALUE_SEARCH_HITS) {
+		search.hits.resize(MAX_VALUE_SEARCH_HITS);
+		search.truncated = true;
+	}
+}
+
+u32 compare_lanes(const u8 *data, const float *pattern, float tolerance)
+{
+#ifdef VUTRACE_SSE2
+	__m128 value = _mm_loadu_ps((const float*) data);
+	__m128 difference = _mm_sub_ps(value, _mm_loadu_ps(pattern));
+	__m128 magnitude = _mm_and_ps(difference, _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)));
+	return _mm_movemask_ps(_mm_cmple_ps(magnitude, _mm_set1_ps(tolerance)));
+#else
+	u32 mask = 0;
+	for(int i = 0; i < 4; i++) {
+		float value;
+		memcpy(&value, &data[i * 4], 4);
+		if(fabsf(value - pattern[i]) <= tolerance) {
+			mask |= 1 << i;
+		}
+	}
+	return mask;
+#endif
+}
+
+bool walk_until_query_match(AppState &app, const QueryTab &tab, int step)
+{
+	return walk_until_event(app, tab.results, step);
+}
+
+bool walk_until_event(AppState &app, const std::vector<std::size_t> &events, int step)
+{
+	ScopedTimer timer(TIMER_NAVIGATION);
+	std::vector<std::size_t>::const_iterator match;
+	if(step > 0) {
+		match = std::upper_bound(events.begin(), events.end(), app.current_snapshot);
+		if(match == events.end()) {
+			return false;
+		}
+	} else {
+		match = std::lower_bound(events.begin(), events.end(), app.current_snapshot);
+		if(match == events.begin()) {
+			return false;
+		}
+		match--;
+	}
+	app.current_snapshot = *match;
+	app.snapshots_scroll_to = true;
+	app.disassembly_scroll_to = true;
+	return true;
+}
+
+VuInsnPair snapshot_ops(const AppState &app, std::size_t snapshot_index)
+{
+	// The instruction table is decoded from the final program, so only decode
+	// again for instructions that belong to an earlier microprogram.
+	const Snapshot &snapshot = app.snapshots[snapshot_index];
+	const Snapshot &last = app.snapshots.back();
+	u32 pc = snapshot.registers.VI[TPC].UL;
+	if(&snapshot == &last || memcmp(&snapshot.program[pc], &last.program[pc], INSN_PAIR_SIZE) == 0) {
+		return app.instructions[pc / INSN_PAIR_SIZE].ops;
+	}
+	return decode_instruction_pair(&snapshot.program[pc]);
+}
+
+void build_event_index(AppState &app)
+{
+	for(std::vector<std::size_t> &events : app.events) {
+		events.clear();
+	}
+	if(!app.snapshots.empty()) {
+		app.events[EVENT_PROGRAM_ENTRY].push_back(0);
+	}
+	
+	// Events are recorded at the snapshot where the responsible instruction is
+	// about to be executed, the same as for queries.
+	for(std::size_t i = 0; i < app.snapshots.size(); i++) {
+		u32 pc = app.snapshots[i].registers.VI[TPC].UL;
+		VuInsnPair ops = snapshot_ops(app, i);
+		if(ops.lower.is_xgkick) {
+			app.events[EVENT_XGKICK].push_back(i);
+		}
+		if(i + 1 < app.snapshots.size() && app.snapshots[i + 1].write_size > 0) {
+			app.events[EVENT_STORE].push_back(i);
+		}
+		if(i + 2 < app.snapshots.size()) {
+			u32 next_pc = app.snapshots[i + 2].registers.VI[TPC].UL;
+			if(ops.lower.flow != VUFLOW_NONE && next_pc != pc + INSN_PAIR_SIZE * 2) {
+				app.events[EVENT_BRANCH_TAKEN].push_back(i);
+			}
+			if(ops.is_end) {
+				app.events[EVENT_PROGRAM_ENTRY].push_back(i + 2);
+			}
+		}
+	}
+}
+
+void toggle_playback(AppState &app, int direction)
+{
+	if(app.playback_direction == direction) {
+		app.playback_direction = 0;
+	} else {
+		app.playback_direction = direction;
+		app.playback_position = app.current_snapshot;
+		app.playback_time = glfwGetTime();
+	}
+}
+
+void update_playback(AppState &app, double time)
+{
+	if(app.playback_direction == 0) {
+		return;
+	}
+	// Snapshots are kept in memory in full, so playback only has to move the
+	// current snapshot. At high speeds, many are skipped each frame.
+	ScopedTimer timer(TIMER_NAVIGATION);
+	if(app.current_snapshot != (std::size_t) app.playback_position) {
+		app.playback_position = app.current_snapshot; // Moved some other way.
+	}
+	// Measure from when playback started rather than using the frame time,
+	// which after an idle wait covers the whole wait. Long frames are clamped
+	// so a stall doesn't skip a big chunk of the trace.
+	double delta_time = std::min(time - app.playback_time, MAX_PLAYBACK_STEP);
+	app.playback_time = time;
+	double last = (double) (app.snapshots.size() - 1);
+	app.playback_position += app.playback_direction * app.playback_speed * delta_time;
+	if(app.playback_position <= 0.0 || app.playback_position >= last) {
+		app.playback_position = std::min(std::max(app.playback_position, 0.0), last);
+		app.playback_direction = 0;
+	}
+	app.current_snapshot = (std::size_t) app.playback_position;
+	app.snapshots_scroll_to = true;
+	app.disassembly_scroll_to = true;
+	redraw_frames = REDRAW_FRAMES;
+}
+
+void add_query_tab(AppState &app, const std::string &text)
+{
+	// Queries can be given a name using the syntax "name: expression".
+	QueryTab tab;
+	std::string expression = text;
+	std::size_t colon = text.find(':');
+	if(colon != std::string::npos) {
+		tab.name = text.substr(0, colon);
+		expression = text.substr(colon + 1);
+		tab.name.erase(0, tab.name.find_first_not_of(" \t"));
+		tab.name.erase(tab.name.find_last_not_of(" \t") + 1);
+	}
+	if(!compile_query(tab.query, expression, app.query_error)) {
+		return;
+	}
+	app.query_error = "";
+	tab.id = app.next_query_id++;
+	tab.text = expression;
+	run_query(app, tab);
+	app.query_tabs.emplace_back(std::move(tab));
+}
+
+void load_query_file(AppState &app, const std::string &path)
+{
+	std::ifstream file(path);
+	if(!file) {
+		app.query_error = "Failed to open " + path + ".";
+		return;
+	}
+	std::string line;
+	while(std::getline(file, line)) {
+		if(line.empty() || line[0] == '#') {
+			continue;
+		}
+		add_query_tab(app, line);
+		if(!app.query_error.empty()) {
+			return;
+		}
+	}
+}
+
+void save_query_file(AppState &app, const std::string &path)
+{
+	std::ofstream file(path);
+	if(!file) {
+		app.query_error = "Failed to open " + path + " for writing.";
+		return;
+	}
+	for(const QueryTab &tab : app.query_tabs) {
+		if(!tab.name.empty()) {
+			file << tab.name << ": ";
+		}
+		file << tab.text << "\n";
+	}
+}
+
+void run_query(AppState &app, QueryTab &tab)
+{
+	ScopedTimer timer(TIMER_QUERY);
+	tab.results.clear();
+	std::mutex results_mutex;
+	parallel_for(app.snapshots.size(), [&](std::size_t begin, std::size_t end) {
+		std::vector<std::size_t> results;
+		for(std::size_t i = begin; i < end; i++) {
+			if(evaluate_query(tab.query, query_context(app, i)) != 0.0) {
+				results.push_back(i);
+			}
+		}
+		std::lock_guard<std::mutex> lock(results_mutex);
+		tab.results.insert(tab.results.end(), results.begin(), results.end());
+	});
+	std::sort(tab.results.begin(), tab.results.end());
+}
+
+QueryContext query_context(AppState &app, std::size_t snapshot_index)
+{
+	Snapshot &snap = app.snapshots[snapshot_index];
+	QueryContext ctx;
+	ctx.registers = &snap.registers;
+	ctx.memory = snap.memory;
+	ctx.index = snapshot_index;
+	ctx.load = -1;
+	ctx.store = -1;
+	// Memory accesses are recorded in the snapshot after the instruction that
+	// performed them.
+	if(snapshot_index + 1 < app.snapshots.size()) {
+		Snapshot &next = app.snapshots[snapshot_index + 1];
+		if(next.read_size > 0) ctx.load = next.read_addr;
+		if(next.write_size > 0) ctx.store = next.write_addr;
+	}
+	return ctx;
+}
+
+void slice_window(AppState &app)
+{
+	ScopedTimer timer(TIMER_SLICE_WINDOW);
+	Slice &slice = app.slice;
+	
+	ImGui::TextWrapped("Backward slice of %s at snapshot %lu.", slice.description.c_str(), slice.snapshot);
+	if(ImGui::Checkbox("Follow address registers", &slice.follow_addresses)) {
+		std::vector<u32> start = slice.start;
+		std::string description = slice.description;
+		compute_slice(app, slice.snapshot, start, description);
+	}
+	ImGui::SetItemTooltip("Also include the instructions that calculated the addresses used by loads and stores.");
+	ImGui::Text("%lu instructions, %lu inputs%s", slice.instructions.size(), slice.inputs.size(), slice.truncated ? " (truncated)" : "");
+	
+	if(ImGui::BeginTabBar("slice_tabs")) {
+		if(ImGui::BeginTabItem("Instructions")) {
+			ImVec2 size = ImGui::GetContentRegionAvail();
+			if(ImGui::BeginListBox("##instructions", size)) {
+				for(std::size_t i : slice.instructions) {
+					u32 pc = app.snapshots[i].registers.VI[TPC].UL;
+					std::string label = std::to_string(i) + ": " + app.instructions[pc / INSN_PAIR_SIZE].disassembly;
+					ImGui::PushID(i);
+					if(ImGui::Selectable(label.c_str(), i == app.current_snapshot)) {
+						app.current_snapshot = i;
+						app.snapshots_scroll_to = true;
+						app.disassembly_scroll_to = true;
+					}
+					ImGui::PopID();
+				}
+				ImGui::EndListBox();
+			}
+			ImGui::EndTabItem();
+		}
+		if(ImGui::BeginTabItem("Inputs")) {
+			ImVec2 size = ImGui::GetContentRegionAvail();
+			if(ImGui::BeginListBox("##inputs", size)) {
+				for(std::size_t i = 0; i < slice.inputs.size(); i++) {
+					u32 location = slice.inputs[i].first;
+					std::size_t changed_at = slice.inputs[i].second;
+					std::string label = location_name(location);
+					if(changed_at > 0) {
+						label += " (changed at " + std::to_string(changed_at) + ")";
+					}
+					ImGui::PushID(i);
+					if(ImGui::Selectable(label.c_str())) {
+						if(changed_at > 0) {
+							app.current_snapshot = changed_at;
+							app.snapshots_scroll_to = true;
+							app.disassembly_scroll_to = true;
+						}
+						if(location >= MEMORY_LOCATION) {
+							app.memory_scroll_to = (location - MEMORY_LOCATION) * 4;
+						}
+					}
+					ImGui::PopID();
+				}
+				ImGui::EndListBox();
+			}
+			ImGui::EndTabItem();
+		}
+		ImGui::EndTabBar();
+	}
+}
+
+void compute_slice(AppState &app, std::size_t snapshot, const std::vector<u32> &start, const std::string &description)
+{
+	ScopedTimer timer(TIMER_ANALYSIS);
+	Slice &slice = app.slice;
+	slice.is_open = true;
+	slice.description = description;
+	slice.snapshot = snapshot;
+	slice.start = start;
+	slice.instructions.clear();
+	slice.inputs.clear();
+	slice.program.reset();
+	slice.truncated = false;
+	
+	// Each work item is a location and the snapshot at which its value was
+	// read. The value was produced by the last change at or before then, so the
+	// change lists take us straight to the responsible instruction.
+	std::vector<std::pair<u32, std::size_t>> worklist;
+	for(u32 location : start) {
+		worklist.emplace_back(location, snapshot);
+	}
+	std::unordered_set<u64> visited;
+	while(!worklist.empty()) {
+		u32 location = worklist.back().first;
+		std::size_t reader = worklist.back().second;
+		worklist.pop_back();
+		
+		const std::vector<u32> &changes = app.changes[location];
+		auto change = std::upper_bound(changes.begin(), changes.end(), reader);
+		std::size_t changed_at = change == changes.begin() ? 0 : *(change - 1);
+		if(!visited.insert(((u64) location << 32) | changed_at).second) {
+			continue;
+		}
+		if(visited.size() > MAX_SLICE_STEPS) {
+			slice.truncated = true;
+			break;
+		}
+		
+		std::size_t producer;
+		VuInsn insn;
+		int def;
+		if(changed_at == 0 || !find_producer(app, location, changed_at, producer, insn, def)) {
+			slice.inputs.emplace_back(location, changed_at);
+			continue;
+		}
+		slice.instructions.push_back(producer);
+		
+		const VuOperand &target = insn.defs[def];
+		for(int i = 0; i < insn.use_count; i++) {
+			const VuOperand &use = insn.uses[i];
+			if(!(use.defs & (1 << def)) || (use.address && !slice.follow_addresses)) {
+				continue;
+			}
+			if(use.reg == VUREG_VF || use.reg == VUREG_VI) {
+				continue; // vf00 and vi00 are constant.
+			}
+			u8 lanes = vu_dependency_lanes(target, location % 4, use);
+			for(u32 lane = 0; lane < 4; lane++) {
+				if(!(lanes & (1 << lane))) {
+					continue;
+				}
+				if(use.reg == VUREG_MEMORY) {
+					u32 address = app.snapshots[producer + 1].read_addr & (VU1_MEMSIZE - 1) & ~0xf;
+					worklist.emplace_back(MEMORY_LOCATION + address / 4 + lane, producer);
+				} else {
+					worklist.emplace_back(use.reg * 4 + lane, producer);
+				}
+			}
+		}
+	}
+	
+	std::sort(slice.instructions.begin(), slice.instructions.end());
+	slice.instructions.erase(std::unique(slice.instructions.begin(), slice.instructions.end()), slice.instructions.end());
+	std::sort(slice.inputs.begin(), slice.inputs.end());
+	for(std::size_t i : slice.instructions) {
+		slice.program[app.snapshots[i].registers.VI[TPC].UL / INSN_PAIR_SIZE] = true;
+	}
+}
+
+bool find_producer(AppState &app, u32 location, std::size_t changed_at, std::size_t &producer, VuInsn &insn, int &def)
+{
+	u8 reg = location < MEMORY_LOCATION ? location / 4 : VUREG_MEMORY;
+	u8 lane = location % 4;
+	
+	// The instruction before the change is normally responsible, but the
+	// results of DIV, the EFU and the flags appear a few instructions late.
+	std::size_t oldest = changed_at - 1;
+	if(reg != VUREG_MEMORY) {
+		oldest = changed_at > SLICE_LOOKBACK ? changed_at - SLICE_LOOKBACK : 0;
+	}
+	for(std::size_t i = changed_at; i-- > oldest;) {
+		VuInsnPair ops = snapshot_ops(app, i);
+		for(const VuInsn *half : {&ops.upper, &ops.lower}) {
+			for(int j = 0; j < half->def_count; j++) {
+				const VuOperand &operand = half->defs[j];
+				if(operand.reg != reg || !(operand.lanes & (1 << lane))) {
+					continue;
+				}
+				if(reg == VUREG_MEMORY) {
+					// Make sure the store hit this quadword.
+					Snapshot &after = app.snapshots[i + 1];
+					u32 address = (location - MEMORY_LOCATION) * 4;
+					if(after.write_size == 0 || (after.write_addr & (VU1_MEMSIZE - 1)) / 0x10 != address / 0x10) {
+						continue;
+					}
+				}
+				producer = i;
+				insn = *half;
+				def = j;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+std::vector<u32> locations_of(u8 reg, u32 address)
+{
+	std::vector<u32> locations;
+	if(reg == VUREG_MEMORY) {
+		for(u32 lane = 0; lane < 4; lane++) {
+			locations.push_back(MEMORY_LOCATION + (address & (VU1_MEMSIZE - 1) & ~0xf) / 4 + lane);
+		}
+	} else if(vu_register_is_vector(reg)) {
+		for(u32 lane = 0; lane < 4; lane++) {
+			locations.push_back(reg * 4 + lane);
+		}
+	} else {
+		locations.push_back(reg * 4);
+	}
+	return locations;
+}
+
+std::string location_name(u32 location)
+{
+	static const char lane_names[] = "xyzw";
+	
+	char name[32];
+	u32 reg = location / 4;
+	if(location >= MEMORY_LOCATION) {
+		snprintf(name, sizeof(name), "mem %04x", (location - MEMORY_LOCATION) * 4);
+	} else if(reg < VUREG_VI) {
+		snprintf(name, sizeof(name), "vf%02d.%c", reg - VUREG_VF, lane_names[location % 4]);
+	} else if(reg >= VUREG_STATUS && reg <= VUREG_I) {
+		static const char *special_names[] = {"Status", "MAC", "Clip", "c2c19", "R", "I"};
+		snprintf(name, sizeof(name), "%s", special_names[reg - VUREG_STATUS]);
+	} else if(reg < VUREG_ACC) {
+		snprintf(name, sizeof(name), "vi%02d", reg - VUREG_VI);
+	} else if(reg == VUREG_ACC) {
+		snprintf(name, sizeof(name), "ACC.%c", lane_names[location % 4]);
+	} else {
+		snprintf(name, sizeof(name), "%s", reg == VUREG_Q ? "Q" : "P");
+	}
+	return name;
+}
+
+u32 *location_pointer(Snapshot &snapshot, u32 location)
+{
+	if(location >= MEMORY_LOCATION) {
+		return (u32*) &snapshot.memory[(location - MEMORY_LOCATION) * 4];
+	}
+	// VF, VI, ACC, Q and P are laid out contiguously as in 'r' packets.
+	return (u32*) &snapshot.registers + location;
+}
+
+void record_change(AppState &app, u32 location)
+{
+	if(location / 4 == VUREG_VI + TPC) {
+		return; // Changes every instruction and is never an operand.
+	}
+	std::size_t index = app.snapshots.size() - 1;
+	Snapshot &snap = app.snapshots[index];
+	if(*location_pointer(snap, location) != *location_pointer(app.snapshots[index - 1], location)) {
+		std::vector<u32> &changes = app.changes[location];
+		if(changes.empty() || changes.back() != index) {
+			changes.push_back(index);
+			u32 address = (location - MEMORY_LOCATION) * 4;
+			bool is_store = snap.write_size > 0 && (snap.write_addr & (VU1_MEMSIZE - 1)) / 0x10 == address / 0x10;
+			if(location >= MEMORY_LOCATION && !is_store) {
+				app.external_writes.emplace_back(index, location);
+			}
+		}
+	}
+}
+
+void taint_window(AppState &app)
+{
+	ScopedTimer timer(TIMER_TAINT_WINDOW);
+	Taint &taint = app.taint;
+	
+	ImGui::InputText("Begin", &taint.begin_text);
+	ImGui::InputText("End", &taint.end_text);
+	ImGui::SetItemTooltip("Inclusive.");
+	if(ImGui::Button("Taint at Current Snapshot")) {
+		taint.begin = from_hex(taint.begin_text);
+		taint.end = from_hex(taint.end_text);
+		taint.error = "";
+		if(taint.begin_text.empty() || taint.end_text.empty()) {
+			taint.error = "No range entered.";
+		} else if(taint.begin > taint.end || taint.end >= VU1_MEMSIZE) {
+			taint.error = "Invalid range.";
+		} else {
+			taint.snapshot = app.current_snapshot;
+			run_taint(app);
+		}
+	}
+	
+	if(!taint.error.empty()) {
+		ImGui::TextColored(ImVec4(1.f, 0.5f, 0.5f, 1.f), "%s", taint.error.c_str());
+		return;
+	}
+	ImGui::Text("%lu tainted quadwords stored, %lu XGKICKs", taint.outputs.size(), taint.kicks.size());
+	
+	if(ImGui::BeginTabBar("taint_tabs")) {
+		if(ImGui::BeginTabItem("Outputs")) {
+			ImVec2 size = ImGui::GetContentRegionAvail();
+			if(ImGui::BeginListBox("##outputs", size)) {
+				for(std::size_t i = 0; i < taint.outputs.size(); i++) {
+					const TaintOutput &output = taint.outputs[i];
+					char label[64];
+					snprintf(label, sizeof(label), "%04x first stored at %lu (%lu stores)", output.address, output.first_snapshot, output.stores);
+					ImGui::PushID(i);
+					if(ImGui::Selectable(label)) {
+						app.current_snapshot = output.first_snapshot;
+						app.snapshots_scroll_to = true;
+						app.disassembly_scroll_to = true;
+						app.memory_scroll_to = output.address;
+					}
+					ImGui::PopID();
+				}
+				ImGui::EndListBox();
+			}
+			ImGui::EndTabItem();
+		}
+		if(ImGui::BeginTabItem("XGKICKs")) {
+			ImVec2 size = ImGui::GetContentRegionAvail();
+			if(ImGui::BeginListBox("##kicks", size)) {
+				for(std::size_t i = 0; i < taint.kicks.size(); i++) {
+					const TaintKick &kick = taint.kicks[i];
+					char label[64];
+					snprintf(label, sizeof(label), "%lu: %04x-%04x (%u/%u tainted)", kick.snapshot, kick.address, kick.address + kick.size, kick.tainted_quadwords, kick.size / 0x10);
+					ImGui::PushID(i);
+					if(ImGui::Selectable(label, kick.snapshot == app.current_snapshot)) {
+						app.current_snapshot = kick.snapshot;
+						app.snapshots_scroll_to = true;
+						app.disassembly_scroll_to = true;
+					}
+					ImGui::PopID();
+				}
+				ImGui::EndListBox();
+			}
+			ImGui::EndTabItem();
+		}
+		ImGui::EndTabBar();
+	}
+}
+
+void run_taint(AppState &app)
+{
+	ScopedTimer timer(TIMER_ANALYSIS);
+	Taint &taint = app.taint;
+	taint.outputs.clear();
+	taint.kicks.clear();
+	
+	std::bitset<LOCATION_COUNT> tainted;
+	for(u32 address = taint.begin & ~3; address <= taint.end; address += 4) {
+		tainted[MEMORY_LOCATION + address / 4] = true;
+	}
+	
+	std::map<u32, TaintOutput> outputs;
+	auto external = std::upper_bound(app.external_writes.begin(), app.external_writes.end(), std::make_pair((u32) taint.snapshot, UINT32_MAX));
+	for(std::size_t i = taint.snapshot; i < app.snapshots.size(); i++) {
+		Snapshot &snap = app.snapshots[i];
+		
+		// Data uploaded from outside the VU replaces whatever was there.
+		for(; external != app.external_writes.end() && external->first <= i; external++) {
+			tainted[external->second] = false;
+		}
+		
+		VuInsnPair ops = snapshot_ops(app, i);
+		if(ops.lower.is_xgkick) {
+			TaintKick kick;
+			kick.snapshot = i;
+			kick.address = (snap.registers.VI[ops.lower.uses[0].reg - VUREG_VI].UL * 0x10) & (VU1_MEMSIZE - 1);
+			kick.size = gs_packet_size(&snap.memory[kick.address], VU1_MEMSIZE - kick.address);
+			kick.tainted_quadwords = 0;
+			for(u32 address = kick.address; address < kick.address + kick.size; address += 0x10) {
+				u32 word = MEMORY_LOCATION + address / 4;
+				if(tainted[word] || tainted[word + 1] || tainted[word + 2] || tainted[word + 3]) {
+					kick.tainted_quadwords++;
+				}
+			}
+			if(kick.tainted_quadwords > 0) {
+				taint.kicks.push_back(kick);
+			}
+		}
+		
+		if(i + 1 >= app.snapshots.size()) {
+			break;
+		}
+		Snapshot &next = app.snapshots[i + 1];
+		u32 read_base = MEMORY_LOCATION + (next.read_addr & (VU1_MEMSIZE - 1) & ~0xf) / 4;
+		u32 write_base = MEMORY_LOCATION + (next.write_addr & (VU1_MEMSIZE - 1) & ~0xf) / 4;
+		
+		// Both halves read the old state, so work out the taint of every def
+		// lane before applying any of them.
+		std::pair<u32, bool> updates[32];
+		int update_count = 0;
+		for(const VuInsn *half : {&ops.upper, &ops.lower}) {
+			for(int j = 0; j < half->def_count; j++) {
+				const VuOperand &def = half->defs[j];
+				if(def.reg == VUREG_MEMORY && next.write_size == 0) {
+					continue;
+				}
+				for(u32 lane = 0; lane < 4; lane++) {
+					if(!(def.lanes & (1 << lane))) {
+						continue;
+					}
+					bool value = false;
+					for(int k = 0; k < half->use_count; k++) {
+						const VuOperand &use = half->uses[k];
+						if(!(use.defs & (1 << j)) || use.address) {
+							continue;
+						}
+						u8 lanes = vu_dependency_lanes(def, lane, use);
+						u32 base = use.reg == VUREG_MEMORY ? read_base : use.reg * 4;
+						for(u32 l = 0; l < 4; l++) {
+							if((lanes & (1 << l)) && tainted[base + l]) {
+								value = true;
+							}
+						}
+					}
+					u32 location = def.reg == VUREG_MEMORY ? write_base + lane : def.reg * 4 + lane;
+					updates[update_count++] = {location, value};
+					if(def.reg == VUREG_MEMORY && value) {
+						TaintOutput &output = outputs[((location - MEMORY_LOCATION) * 4) & ~0xf];
+						if(output.stores == 0) {
+							output.first_snapshot = i + 1;
+						}
+						if(output.stores == 0 || output.last_snapshot != i + 1) {
+							output.last_snapshot = i + 1;
+							output.stores++;
+						}
+					}
+				}
+			}
+		}
+		for(int j = 0; j < update_count; j++) {
+			tainted[updates[j].first] = updates[j].second;
+		}
+	}
+	
+	for(auto &output : outputs) {
+		output.second.address = output.first;
+		taint.outputs.push_back(output.second);
+	}
+}
+
+void loop_table_window(AppState &app)
+{
+	ScopedTimer timer(TIMER_LOOP_TABLE_WINDOW);
+	LoopTable &table = app.loop_table;
+	
+	if(app.loop_heads.empty()) {
+		ImGui::Text("No loops found.");
+		return;
+	}
+	
+	char preview[64];
+	snprintf(preview, sizeof(preview), "%x (%lu iterations)", table.head, app.instructions[table.head / INSN_PAIR_SIZE].executions.size());
+	if(ImGui::BeginCombo("Loop", preview)) {
+		for(u32 head : app.loop_heads) {
+			char label[64];
+			snprintf(label, sizeof(label), "%x (%lu iterations)", head, app.instructions[head / INSN_PAIR_SIZE].executions.size());
+			if(ImGui::Selectable(label, head == table.head)) {
+				table.head = head;
+			}
+		}
+		ImGui::EndCombo();
+	}
+	if(ImGui::InputText("Columns", &table.columns_text, ImGuiInputTextFlags_EnterReturnsTrue)) {
+		compile_loop_columns(app);
+	}
+	ImGui::SetItemTooltip("Query expressions separated by semicolons, evaluated at the loop head.\nPress enter to apply.");
+	if(!table.error.empty()) {
+		ImGui::TextColored(ImVec4(1.f, 0.5f, 0.5f, 1.f), "%s", table.error.c_str());
+	}
+	
+	// Each row is one execution of the loop head, so the per-instruction
+	// execution lists can be indexed directly and only visible rows evaluated.
+	const std::vector<std::size_t> &iterations = app.instructions[table.head / INSN_PAIR_SIZE].executions;
+	if(table.variants_head != table.head) {
+		find_loop_variants(app);
+	}
+	ImGui::Text("%u distinct paths through the loop body.", table.variant_count);
+	ImGuiTableFlags flags = ImGuiTableFlags_ScrollY | ImGuiTableFlags_ScrollX | ImGuiTableFlags_RowBg |
+		ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_Resizable;
+	if(ImGui::BeginTable("iterations", 3 + table.columns.size(), flags)) {
+		ImGui::TableSetupScrollFreeze(3, 1);
+		ImGui::TableSetupColumn("Iteration");
+		ImGui::TableSetupColumn("Snapshot");
+		ImGui::TableSetupColumn("Path");
+		for(const std::string &name : table.column_names) {
+			ImGui::TableSetupColumn(name.c_str());
+		}
+		ImGui::TableHeadersRow();
+		
+		ImGuiListClipper clipper;
+		clipper.Begin(iterations.size());
+		while(clipper.Step()) {
+			for(int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+				std::size_t snapshot = iterations[row];
+				ImGui::TableNextRow();
+				ImGui::TableSetColumnIndex(0);
+				ImGui::PushID(row);
+				std::string label = std::to_string(row);
+				if(ImGui::Selectable(label.c_str(), snapshot == app.current_snapshot, ImGuiSelectableFlags_SpanAllColumns)) {
+					app.current_snapshot = snapshot;
+					app.snapshots_scroll_to = true;
+					app.disassembly_scroll_to = true;
+				}
+				ImGui::PopID();
+				ImGui::TableSetColumnIndex(1);
+				ImGui::Text("%lu", snapshot);
+				ImGui::TableSetColumnIndex(2);
+				if(table.variants[row] == 0) {
+					ImGui::Text("%u", table.variants[row]);
+				} else {
+					ImGui::TextColored(ImVec4(1.f, 0.5f, 0.5f, 1.f), "%u", table.variants[row]);
+				}
+				QueryContext ctx = query_context(app, snapshot);
+				for(std::size_t i = 0; i < table.columns.size(); i++) {
+					ImGui::TableSetColumnIndex(3 + i);
+					double value = evaluate_query(table.columns[i], ctx);
+					if(value == (s64) value) {
+						ImGui::Text("%lld", (long long) value);
+					} else {
+						ImGui::Text("%g", value);
+					}
+				}
+			}
+		}
+		ImGui::EndTable();
+	}
+}
+
+void compile_loop_columns(AppState &app)
+{
+	LoopTable &table = app.loop_table;
+	std::vector<std::string> names;
+	std::vector<Query> columns;
+	table.error = "";
+	std::stringstream text(table.columns_text);
+	std::string name;
+	while(std::getline(text, name, ';')) {
+		std::size_t begin = name.find_first_not_of(" \t");
+		if(begin == std::string::npos) {
+			continue;
+		}
+		name = name.substr(begin, name.find_last_not_of(" \t") - begin + 1);
+		Query query;
+		std::string error;
+		if(!compile_query(query, name, error)) {
+			table.error = name + ": " + error;
+			return;
+		}
+		if(columns.size() >= MAX_LOOP_COLUMNS) {
+			table.error = "Too many columns.";
+			return;
+		}
+		names.push_back(name);
+		columns.push_back(query);
+	}
+	table.column_names = std::move(names);
+	table.columns = std::move(columns);
+}
+
+void anomalies_window(AppState &app)
+{
+	ScopedTimer timer(TIMER_ANOMALIES_WINDOW);
+	static const char *type_names[ANOMALY_TYPE_COUNT] = {"NaN", "Inf", "Denormal", "Clamped"};
+	AnomalyScan &scan = app.anomaly_scan;
+	
+	if(ImGui::Button("Scan")) {
+		scan_anomalies(app);
+	}
+	ImGui::SameLine();
+	ImGui::Checkbox("Include Memory", &scan.include_memory);
+	ImGui::SetItemTooltip("Also check stores and data uploaded by VIF. Integer data will show up as false positives.");
+	
+	if(!scan.has_run) {
+		ImGui::TextWrapped("Checks the results of floating point instructions for values that are special cases in IEEE-754 but not on the VU.");
+		return;
+	}
+	ImGui::Text("%lu NaN, %lu Inf, %lu denormal, %lu clamped%s",
+		scan.counts[ANOMALY_NAN], scan.counts[ANOMALY_INF], scan.counts[ANOMALY_DENORMAL], scan.counts[ANOMALY_CLAMPED],
+		scan.truncated ? " (truncated)" : "");
+	
+	ImVec2 size = ImGui::GetContentRegionAvail();
+	if(ImGui::BeginListBox("##anomalies", size)) {
+		ImGuiListClipper clipper;
+		clipper.Begin(scan.anomalies.size());
+		while(clipper.Step()) {
+			for(int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+				const Anomaly &anomaly = scan.anomalies[i];
+				std::string label = std::to_string(anomaly.snapshot) + ": " + location_name(anomaly.location) +
+					" " + type_names[anomaly.type] + " (" + to_hex(anomaly.value) + ")";
+				if(anomaly.producer != SIZE_MAX) {
+					u32 pc = app.snapshots[anomaly.producer].registers.VI[TPC].UL;
+					label += " from " + app.instructions[pc / INSN_PAIR_SIZE].disassembly;
+				}
+				ImGui::PushID(i);
+				if(ImGui::Selectable(label.c_str())) {
+					app.current_snapshot = anomaly.producer != SIZE_MAX ? anomaly.producer : anomaly.snapshot;
+					app.snapshots_scroll_to = true;
+					app.disassembly_scroll_to = true;
+					if(anomaly.location >= MEMORY_LOCATION) {
+						app.memory_scroll_to = (anomaly.location - MEMORY_LOCATION) * 4;
+					}
+				}
+				ImGui::PopID();
+			}
+		}
+		ImGui::EndListBox();
+	}
+}
+
+void scan_anomalies(AppState &app)
+{
+	ScopedTimer timer(TIMER_ANALYSIS);
+	AnomalyScan &scan = app.anomaly_scan;
+	scan.anomalies.clear();
+	scan.truncated = false;
+	scan.has_run = true;
+	for(std::size_t &count : scan.counts) {
+		count = 0;
+	}
+	if(app.snapshots.size() < 2) {
+		return;
+	}
+	
+	// The registers that hold floats. Q, P and I only use their first lane.
+	std::vector<u8> float_registers;
+	for(u8 reg = VUREG_VF + 1; reg < VUREG_VI; reg++) {
+		float_registers.push_back(reg);
+	}
+	float_registers.push_back(VUREG_ACC);
+	float_registers.push_back(VUREG_Q);
+	float_registers.push_back(VUREG_P);
+	float_registers.push_back(VUREG_I);
+	
+	std::mutex anomalies_mutex;
+	parallel_for(app.snapshots.size() - 1, [&](std::size_t begin, std::size_t end) {
+		std::vector<Anomaly> anomalies;
+		std::size_t counts[ANOMALY_TYPE_COUNT] = {};
+		auto push_anomalies = [&](std::size_t snapshot, u32 base, const u8 *data, u32 lanes, bool registers_only) {
+			LaneAnomalies result = classify_lanes(data);
+			for(int type = 0; type < ANOMALY_TYPE_COUNT; type++) {
+				u32 mask = result.masks[type] & lanes;
+				for(u32 lane = 0; mask != 0; lane++, mask >>= 1) {
+					if(!(mask & 1)) {
+						continue;
+					}
+					Anomaly anomaly;
+					anomaly.snapshot = snapshot;
+					anomaly.location = base + lane;
+					anomaly.type = (AnomalyType) type;
+					memcpy(&anomaly.value, &data[lane * 4], 4);
+					std::size_t producer;
+					VuInsn insn;
+					int def;
+					if(find_producer(app, anomaly.location, snapshot, producer, insn, def)) {
+						if(registers_only && !insn.is_float) {
+							continue; // Integer data moved through a float register.
+						}
+						anomaly.producer = producer;
+					} else {
+						if(registers_only) {
+							continue;
+						}
+						anomaly.producer = SIZE_MAX;
+					}
+					counts[type]++;
+					if(anomalies.size() < MAX_ANOMALIES) {
+						anomalies.push_back(anomaly);
+					}
+				}
+			}
+		};
+		
+		for(std::size_t i = begin + 1; i < end + 1; i++) {
+			Snapshot &snap = app.snapshots[i];
+			Snapshot &last = app.snapshots[i - 1];
+			for(u8 reg : float_registers) {
+				u32 lanes = vu_register_is_vector(reg) ? 0xf : 0x1;
+				const u8 *value = (const u8*) location_pointer(snap, reg * 4);
+				lanes &= changed_lanes(value, (const u8*) location_pointer(last, reg * 4));
+				if(lanes != 0) {
+					push_anomalies(i, reg * 4, value, lanes, true);
+				}
+			}
+			if(scan.include_memory && snap.write_size > 0) {
+				u32 address = snap.write_addr & (VU1_MEMSIZE - 1) & ~0xf;
+				u32 lanes = changed_lanes(&snap.memory[address], &last.memory[address]);
+				if(lanes != 0) {
+					push_anomalies(i, MEMORY_LOCATION + address / 4, &snap.memory[address], lanes, false);
+				}
+			}
+		}
+		
+		std::lock_guard<std::mutex> lock(anomalies_mutex);
+		scan.anomalies.insert(scan.anomalies.end(), anomalies.begin(), anomalies.end());
+		for(int type = 0; type < ANOMALY_TYPE_COUNT; type++) {
+			scan.counts[type] += counts[type];
+		}
+	});
+	
+	if(scan.include_memory) {
+		// Data uploaded from outside the VU, checked a word at a time.
+		for(const std::pair<u32, u32> &write : app.external_writes) {
+			u8 data[16] = {};
+			memcpy(data, location_pointer(app.snapshots[write.first], write.second), 4);
+			LaneAnomalies result = classify_lanes(data);
+			for(int type = 0; type < ANOMALY_TYPE_COUNT; type++) {
+				if(result.masks[type] & 1) {
+					scan.counts[type]++;
+					scan.anomalies.push_back({write.first, SIZE_MAX, write.second, *(u32*) data, (AnomalyType) type});
+				}
+			}
+		}
+	}
+	
+	std::sort(scan.anomalies.begin(), scan.anomalies.end(), [](const Anomaly &lhs, const Anomaly &rhs) {
+		if(lhs.snapshot != rhs.snapshot) return lhs.snapshot < rhs.snapshot;
+		return lhs.location < rhs.location;
+	});
+	if(scan.anomalies.size() > MAX_ANOMALIES) {
+		scan.anomalies.resize(MAX_ANOMALIES);
+		scan.truncated = true;
+	}
+}
+
+LaneAnomalies classify_lanes(const u8 *data)
+{
+	LaneAnomalies result;
+#ifdef VUTRACE_SSE2
+	__m128i value = _mm_loadu_si128((const __m128i*) data);
+	__m128i zero = _mm_setzero_si128();
+	__m128i exponent = _mm_and_si128(value, _mm_set1_epi32(0x7f800000));
+	__m128i mantissa = _mm_and_si128(value, _mm_set1_epi32(0x007fffff));
+	__m128i magnitude = _mm_and_si128(value, _mm_set1_epi32(0x7fffffff));
+	__m128i max_exponent = _mm_cmpeq_epi32(exponent, _mm_set1_epi32(0x7f800000));
+	__m128i zero_exponent = _mm_cmpeq_epi32(exponent, zero);
+	__m128i zero_mantissa = _mm_cmpeq_epi32(mantissa, zero);
+	result.masks[ANOMALY_NAN] = _mm_movemask_ps(_mm_castsi128_ps(_mm_andnot_si128(zero_mantissa, max_exponent)));
+	result.masks[ANOMALY_INF] = _mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(zero_mantissa, max_exponent)));
+	result.masks[ANOMALY_DENORMAL] = _mm_movemask_ps(_mm_castsi128_ps(_mm_andnot_si128(zero_mantissa, zero_exponent)));
+	result.masks[ANOMALY_CLAMPED] = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(magnitude, _mm_set1_epi32(0x7f7fffff))));
+#else
+	for(u32 &mask : result.masks) {
+		mask = 0;
+	}
+	for(int i = 0; i < 4; i++) {
+		u32 value;
+		memcpy(&value, &data[i * 4], 4);
+		u32 exponent = value & 0x7f800000;
+		u32 mantissa = value & 0x007fffff;
+		if(exponent == 0x7f800000) {
+			result.masks[mantissa != 0 ? ANOMALY_NAN : ANOMALY_INF] |= 1 << i;
+		} else if(exponent == 0 && mantissa != 0) {
+			result.masks[ANOMALY_DENORMAL] |= 1 << i;
+		} else if((value & 0x7fffffff) == 0x7f7fffff) {
+			result.masks[ANOMALY_CLAMPED] |= 1 << i;
+		}
+	}
+#endif
+	return result;
+}
+
+u32 changed_lanes(const u8 *lhs, const u8 *rhs)
+{
+#ifdef VUTRACE_SSE2
+	__m128i equal = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) lhs), _mm_loadu_si128((const __m128i*) rhs));
+	return ~_mm_movemask_ps(_mm_castsi128_ps(equal)) & 0xf;
+#else
+	u32 mask = 0;
+	for(int i = 0; i < 4; i++) {
+		if(memcmp(&lhs[i * 4], &rhs[i * 4], 4) != 0) {
+			mask |= 1 << i;
+		}
+	}
+	return mask;
+#endif
+}
+
+void record_access(AccessPattern &pattern, u32 address)
+{
+	s32 delta = (s32) address - (s32) pattern.last_address;
+	if(pattern.run_length == 1) {
+		pattern.run_stride = delta;
+		pattern.run_length++;
+	} else if(pattern.run_length > 1 && delta == pattern.run_stride) {
+		pattern.run_length++;
+	} else {
+		end_access_run(pattern);
+		pattern.run_base = address;
+		pattern.run_stride = 0;
+		pattern.run_length = 1;
+	}
+	pattern.last_address = address;
+	pattern.accesses++;
+}
+
+void end_access_run(AccessPattern &pattern)
+{
+	if(pattern.run_length > pattern.count) {
+		pattern.base = pattern.run_base;
+		pattern.stride = pattern.run_stride;
+		pattern.count = pattern.run_length;
+	}
+	if(pattern.run_length >= MIN_STRIDE_RUN) {
+		pattern.runs++;
+	}
+	pattern.run_length = 0;
+}
+
+std::string format_access(const AccessPattern &pattern)
+{
+	if(pattern.accesses == 0) {
+		return "";
+	}
+	const char *type = pattern.is_store ? "store" : "load";
+	char text[128];
+	if(pattern.stride == 0 || pattern.count == 1) {
+		snprintf(text, sizeof(text), "%s %s %x", type, pattern.count == pattern.accesses ? "always" : "mostly", pattern.base);
+	} else if(pattern.count >= MIN_STRIDE_RUN) {
+		snprintf(text, sizeof(text), "%s %x %c %x * %u", type, pattern.base, pattern.stride < 0 ? '-' : '+', abs(pattern.stride), pattern.count);
+		if(pattern.runs > 1) {
+			snprintf(text + strlen(text), sizeof(text) - strlen(text), " (%lu runs)", pattern.runs);
+		}
+	} else {
+		snprintf(text, sizeof(text), "%s, no pattern", type);
+	}
+	return text;
+}
+
+void find_buffers(AppState &app)
+{
+	app.buffers.clear();
+	for(std::size_t i = 0; i < app.instructions.size(); i++) {
+		const AccessPattern &pattern = app.instructions[i].access;
+		if(pattern.count < MIN_STRIDE_RUN || pattern.stride == 0) {
+			continue;
+		}
+		u32 stride = abs(pattern.stride);
+		u32 base = pattern.stride > 0 ? pattern.base : pattern.base - stride * (pattern.count - 1);
+		u32 end = base + stride * pattern.count;
+		
+		// Accesses with the same stride that overlap are different fields of
+		// the same elements.
+		MemoryBuffer *buffer = nullptr;
+		for(MemoryBuffer &existing : app.buffers) {
+			if(existing.stride == stride && existing.is_output == pattern.is_store &&
+				base < existing.base + existing.stride * existing.count && existing.base < end) {
+				buffer = &existing;
+				break;
+			}
+		}
+		if(buffer == nullptr) {
+			app.buffers.push_back({base, stride, pattern.count, pattern.is_store, {}});
+			buffer = &app.buffers.back();
+		}
+		buffer->fields.emplace_back(base, i * INSN_PAIR_SIZE);
+		u32 buffer_end = std::max(buffer->base + buffer->stride * buffer->count, end);
+		buffer->base = std::min(buffer->base, base);
+		buffer->count = (buffer_end - buffer->base) / stride;
+	}
+	
+	for(MemoryBuffer &buffer : app.buffers) {
+		for(std::pair<u32, u32> &field : buffer.fields) {
+			field.first = (field.first - buffer.base) % buffer.stride;
+		}
+		std::sort(buffer.fields.begin(), buffer.fields.end());
+	}
+}
+
+const MemoryBuffer *buffer_at(AppState &app, u32 address)
+{
+	for(const MemoryBuffer &buffer : app.buffers) {
+		if(address >= buffer.base && address < buffer.base + buffer.stride * buffer.count) {
+			return &buffer;
+		}
+	}
+	return nullptr;
+}
+
+u64 hash_word(u32 location, u32 value)
+{
+	// splitmix64 finalizer.
+	u64 x = ((u64) location << 32) | value;
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ull;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebull;
+	x ^= x >> 31;
+	return x;
+}
+
+void state_hashes_window(AppState &app)
+{
+	ScopedTimer timer(TIMER_STATE_HASHES_WINDOW);
+	StateHashes &hashes = app.state_hashes;
+	
+	if(hashes.first_seen.empty()) {
+		for(std::size_t i = 0; i < app.snapshots.size(); i++) {
+			hashes.first_seen.emplace(app.snapshots[i].hash, i);
+		}
+	}
+	Snapshot &current = app.snapshots[app.current_snapshot];
+	ImGui::Text("Hash: %016llx", (unsigned long long) current.hash);
+	ImGui::Text("%lu distinct states in %lu snapshots.", hashes.first_seen.size(), app.snapshots.size());
+	std::size_t first = hashes.first_seen.at(current.hash);
+	if(first != app.current_snapshot) {
+		ImGui::AlignTextToFramePadding();
+		ImGui::Text("Same state as snapshot %lu.", first);
+		ImGui::SameLine();
+		if(ImGui::Button("Go")) {
+			app.current_snapshot = first;
+			app.snapshots_scroll_to = true;
+			app.disassembly_scroll_to = true;
+		}
+	}
+	
+	ImGui::Separator();
+	ImGui::InputText("Other Trace", &hashes.compare_path);
+	ImGui::SameLine();
+	if(ImGui::Button("Compare")) {
+		compare_trace(app);
+	}
+	if(!hashes.compare_error.empty()) {
+		ImGui::TextColored(ImVec4(1.f, 0.5f, 0.5f, 1.f), "%s", hashes.compare_error.c_str());
+		return;
+	}
+	if(hashes.compare_hashes.empty()) {
+		return;
+	}
+	ImGui::Text("%lu snapshots vs %lu, %lu differ.", app.snapshots.size(), hashes.compare_hashes.size(), hashes.difference_count);
+	if(hashes.first_difference == SIZE_MAX) {
+		ImGui::Text("The traces are identical.");
+		return;
+	}
+	ImGui::AlignTextToFramePadding();
+	ImGui::Text("First difference at snapshot %lu.", hashes.first_difference);
+	ImGui::SameLine();
+	if(ImGui::Button("Go##first")) {
+		app.current_snapshot = std::min(hashes.first_difference, app.snapshots.size() - 1);
+		app.snapshots_scroll_to = true;
+		app.disassembly_scroll_to = true;
+	}
+	if(app.current_snapshot < hashes.compare_hashes.size()) {
+		bool same = hashes.compare_hashes[app.current_snapshot] == current.hash;
+		ImGui::Text("Current snapshot: %s", same ? "same" : "different");
+	} else {
+		ImGui::Text("Current snapshot: past the end of the other trace");
+	}
+}
+
+void compare_trace(AppState &app)
+{
+	ScopedTimer timer(TIMER_ANALYSIS);
+	StateHashes &hashes = app.state_hashes;
+	hashes.compare_error = "";
+	hashes.compare_hashes.clear();
+	
+	if(!parse_trace(app, hashes.compare_path, &hashes.compare_hashes, &hashes.compare_error)) {
+		hashes.compare_hashes.clear();
+		return;
+	}
+	
+	std::size_t common = std::min(app.snapshots.size(), hashes.compare_hashes.size());
+	hashes.first_difference = SIZE_MAX;
+	hashes.difference_count = std::max(app.snapshots.size(), hashes.compare_hashes.size()) - common;
+	for(std::size_t i = 0; i < common; i++) {
+		if(app.snapshots[i].hash != hashes.compare_hashes[i]) {
+			if(hashes.first_difference == SIZE_MAX) {
+				hashes.first_difference = i;
+			}
+			hashes.difference_count++;
+		}
+	}
+	if(hashes.first_difference == SIZE_MAX && hashes.difference_count > 0) {
+		hashes.first_difference = common;
+	}
+}
+
+void heatmap_window(AppState &app)
+{
+	ScopedTimer timer(TIMER_HEATMAP_WINDOW);
+	Heatmap &heatmap = app.heatmap;
+	
+	if(!heatmap.worker.joinable()) {
+		heatmap.worker = std::thread(build_heatmap, std::ref(app));
+	}
+	if(!heatmap.ready) {
+		ImGui::Text("Building heatmap...");
+		return;
+	}
+	if(heatmap.textures.empty()) {
+		upload_heatmap(heatmap);
+	}
+	
+	ImGui::TextDisabled("Red: stores, green: loads, blue: VIF writes. %lu snapshots per column.", heatmap.bucket_size);
+	
+	ImVec2 min = ImGui::GetCursorScreenPos();
+	ImVec2 size = ImGui::GetContentRegionAvail();
+	size.x = std::max(size.x, 16.f);
+	size.y = std::max(size.y, 16.f);
+	ImGui::InvisibleButton("heatmap", size);
+	ImVec2 max(min.x + size.x, min.y + size.y);
+	
+	fit_strip_view(heatmap.view, (double) heatmap.columns);
+	double view_columns = heatmap.view.end - heatmap.view.begin;
+	
+	// Use the finest level that doesn't have more columns than pixels.
+	std::size_t level = 0;
+	while(level + 1 < heatmap.textures.size() && view_columns / (1 << level) > size.x) {
+		level++;
+	}
+	double level_columns = (double) (1 << level);
+	
+	ImDrawList *dl = ImGui::GetWindowDrawList();
+	dl->PushClipRect(min, max, true);
+	const std::vector<GLuint> &tiles = heatmap.textures[level];
+	for(std::size_t tile = 0; tile < tiles.size(); tile++) {
+		double tile_begin = tile * HEATMAP_TILE_WIDTH * level_columns;
+		double tile_end = tile_begin + HEATMAP_TILE_WIDTH * level_columns;
+		if(tile_end < heatmap.view.begin || tile_begin > heatmap.view.end) {
+			continue;
+		}
+		float x0 = min.x + (float) ((tile_begin - heatmap.view.begin) / view_columns * size.x);
+		float x1 = min.x + (float) ((tile_end - heatmap.view.begin) / view_columns * size.x);
+		dl->AddImage((ImTextureID) (intptr_t) tiles[tile], ImVec2(x0, min.y), ImVec2(x1, max.y));
+	}
+	
+	double current_column = (double) app.current_snapshot / heatmap.bucket_size;
+	if(current_column >= heatmap.view.begin && current_column < heatmap.view.end) {
+		float x = min.x + (float) ((current_column - heatmap.view.begin) / view_columns * size.x);
+		dl->AddLine(ImVec2(x, min.y), ImVec2(x, max.y), IM_COL32(255, 255, 0, 160));
+	}
+	dl->PopClipRect();
+	
+	// Hover to inspect and click to go to the snapshot and address.
+	double column;
+	if(strip_input(heatmap.view, (double) heatmap.columns, 8.0, min, size, column)) {
+		ImVec2 mouse = ImGui::GetMousePos();
+		std::size_t snapshot = std::min((std::size_t) (column * heatmap.bucket_size), app.snapshots.size() - 1);
+		u32 row = std::min((u32) ((mouse.y - min.y) / size.y * HEATMAP_ROWS), (u32) HEATMAP_ROWS - 1);
+		ImGui::SetTooltip("Snapshot %lu\nQuadword %04x", snapshot, row * 0x10);
+		
+		if(ImGui::IsItemClicked(ImGuiMouseButton_Left)) {
+			app.current_snapshot = snapshot;
+			app.memory_scroll_to = row * 0x10;
+			app.snapshots_scroll_to = true;
+			app.disassembly_scroll_to = true;
+		}
+	}
+}
+
+void build_heatmap(AppState &app)
+{
+	Heatmap &heatmap = app.heatmap;
+	std::size_t snapshot_count = app.snapshots.size();
+	heatmap.bucket_size = std::max((snapshot_count + MAX_HEATMAP_COLUMNS - 1) / MAX_HEATMAP_COLUMNS, (std::size_t) 1);
+	heatmap.columns = (snapshot_count + heatmap.bucket_size - 1) / heatmap.bucket_size;
+	
+	const auto tile_size = [](std::size_t columns) {
+		return ((columns + HEATMAP_TILE_WIDTH - 1) / HEATMAP_TILE_WIDTH) * HEATMAP_TILE_WIDTH * HEATMAP_ROWS;
+	};
+	const auto texel = [](std::vector<u32> &texels, std::size_t column, u32 row) -> u32& {
+		std::size_t tile = column / HEATMAP_TILE_WIDTH;
+		return texels[(tile * HEATMAP_ROWS + row) * HEATMAP_TILE_WIDTH + column % HEATMAP_TILE_WIDTH];
+	};
+	const auto intensity = [](u32 count) -> u32 {
+		return count == 0 ? 0 : std::min(64 + (u32) (48.f * log2f((float) count + 1.f)), 255u);
+	};
+	
+	// Memory accesses are recorded in the snapshot after the instruction
+	// that performed them.
+	std::vector<u32> finest(tile_size(heatmap.columns), 0);
+	std::vector<std::array<u32, 3>> counts(HEATMAP_ROWS);
+	auto external = app.external_writes.begin();
+	for(std::size_t column = 0; column < heatmap.columns; column++) {
+		if(heatmap.cancel) {
+			return;
+		}
+		std::fill(counts.begin(), counts.end(), std::array<u32, 3>{0, 0, 0});
+		std::size_t end = std::min((column + 1) * heatmap.bucket_size, snapshot_count);
+		for(std::size_t i = column * heatmap.bucket_size; i < end; i++) {
+			if(i + 1 < snapshot_count) {
+				Snapshot &next = app.snapshots[i + 1];
+				if(next.write_size > 0) {
+					counts[(next.write_addr & (VU1_MEMSIZE - 1)) / 0x10][0]++;
+				}
+				if(next.read_size > 0) {
+					counts[(next.read_addr & (VU1_MEMSIZE - 1)) / 0x10][1]++;
+				}
+			}
+			for(; external != app.external_writes.end() && external->first <= i; external++) {
+				counts[(external->second - MEMORY_LOCATION) / 4][2]++;
+			}
+		}
+		for(u32 row = 0; row < HEATMAP_ROWS; row++) {
+			const std::array<u32, 3> &count = counts[row];
+			u32 alpha = (count[0] | count[1] | count[2]) ? 0xff000000 : 0;
+			texel(finest, column, row) = alpha | intensity(count[2]) << 16 | intensity(count[1]) << 8 | intensity(count[0]);
+		}
+	}
+	heatmap.levels.emplace_back(std::move(finest));
+	
+	std::size_t columns = heatmap.columns;
+	while(columns > HEATMAP_TILE_WIDTH) {
+		std::size_t coarser_columns = (columns + 1) / 2;
+		std::vector<u32> coarser(tile_size(coarser_columns), 0);
+		std::vector<u32> &finer = heatmap.levels.back();
+		for(std::size_t column = 0; column < coarser_columns; column++) {
+			for(u32 row = 0; row < HEATMAP_ROWS; row++) {
+				u32 lhs = texel(finer, column * 2, row);
+				u32 rhs = column * 2 + 1 < columns ? texel(finer, column * 2 + 1, row) : 0;
+				u32 result = 0;
+				for(u32 shift = 0; shift < 32; shift += 8) {
+					result |= std::max((lhs >> shift) & 0xff, (rhs >> shift) & 0xff) << shift;
+				}
+				texel(coarser, column, row) = result;
+			}
+		}
+		heatmap.levels.emplace_back(std::move(coarser));
+		columns = coarser_columns;
+	}
+	
+	heatmap.ready = true;
+	request_redraw();
+}
+
+void upload_heatmap(Heatmap &heatmap)
+{
+	for(const std::vector<u32> &level : heatmap.levels) {
+		heatmap.textures.emplace_back();
+		std::vector<GLuint> &tiles = heatmap.textures.back();
+		tiles.resize(level.size() / (HEATMAP_TILE_WIDTH * HEATMAP_ROWS));
+		glGenTextures(tiles.size(), tiles.data());
+		for(std::size_t tile = 0; tile < tiles.size(); tile++) {
+			glBindTexture(GL_TEXTURE_2D, tiles[tile]);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, HEATMAP_TILE_WIDTH, HEATMAP_ROWS, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+				&level[tile * HEATMAP_TILE_WIDTH * HEATMAP_ROWS]);
+		}
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	
+	// The texels aren't needed once they're on the GPU.
+	heatmap.levels.clear();
+	heatmap.levels.shrink_to_fit();
+}
+
+void timeline_window(AppState &app)
+{
+	ScopedTimer timer(TIMER_TIMELINE_WINDOW);
+	Timeline &timeline = app.timeline;
+	if(timeline.pcs.levels.empty()) {
+		build_timeline(app);
+	}
+	if(app.snapshots.empty() || timeline.highest_pc < timeline.lowest_pc) {
+		return;
+	}
+	
+	ImVec2 min = ImGui::GetCursorScreenPos();
+	ImVec2 size = ImGui::GetContentRegionAvail();
+	size.x = std::max(size.x, 16.f);
+	size.y = std::max(size.y, 16.f);
+	ImGui::InvisibleButton("timeline", size);
+	ImVec2 max(min.x + size.x, min.y + size.y);
+	
+	fit_strip_view(timeline.view, (double) app.snapshots.size());
+	std::size_t begin = (std::size_t) timeline.view.begin;
+	std::size_t end = (std::size_t) timeline.view.end;
+	int width = (int) size.x;
+	float pc_scale = size.y / (timeline.highest_pc + INSN_PAIR_SIZE - timeline.lowest_pc);
+	const auto pc_y = [&](u32 pc) { return min.y + (pc - timeline.lowest_pc) * pc_scale; };
+	
+	// Each column is drawn as bars covering the range of PCs executed in it,
+	// split up and coloured by basic block. If a column covers too many
+	// blocks it's drawn in grey instead.
+	ImDrawList *dl = ImGui::GetWindowDrawList();
+	dl->PushClipRect(min, max, true);
+	for(int x = 0; x < width; x++) {
+		std::size_t column_begin = begin + (end - begin) * x / width;
+		std::size_t column_end = std::min(std::max(begin + (end - begin) * (x + 1) / width, column_begin + 1), end);
+		std::pair<u16, u16> range = timeline_range(app, column_begin, column_end);
+		if(range.first > range.second) {
+			continue;
+		}
+		float x0 = min.x + x;
+		float x1 = std::max(min.x + (float) (column_end - begin) * size.x / (end - begin), x0 + 1.f);
+		u32 first_block = app.block_of[range.first / INSN_PAIR_SIZE];
+		u32 last_block = app.block_of[range.second / INSN_PAIR_SIZE];
+		if(last_block - first_block >= MAX_TIMELINE_BLOCKS_PER_COLUMN) {
+			dl->AddRectFilled(ImVec2(x0, pc_y(range.first)), ImVec2(x1, pc_y(range.second + INSN_PAIR_SIZE)), IM_COL32(160, 160, 160, 255));
+			continue;
+		}
+		for(u32 block = first_block; block <= last_block; block++) {
+			u32 top = std::max((u32) range.first, app.blocks[block].begin);
+			u32 bottom = std::min((u32) range.second + INSN_PAIR_SIZE, app.blocks[block].end);
+			dl->AddRectFilled(ImVec2(x0, pc_y(top)), ImVec2(x1, std::max(pc_y(bottom), pc_y(top) + 1.f)), timeline_block_colour(block));
+		}
+	}
+	
+	// Mark XGKICKs along the top edge.
+	const std::vector<std::size_t> &kicks = app.events[EVENT_XGKICK];
+	for(int x = 0; x < width; x++) {
+		std::size_t column_begin = begin + (end - begin) * x / width;
+		std::size_t column_end = std::max(begin + (end - begin) * (x + 1) / width, column_begin + 1);
+		auto kick = std::lower_bound(kicks.begin(), kicks.end(), column_begin);
+		if(kick != kicks.end() && *kick < column_end) {
+			dl->AddLine(ImVec2(min.x + x + .5f, min.y), ImVec2(min.x + x + .5f, min.y + 6.f), IM_COL32(255, 64, 255, 255));
+		}
+	}
+	
+	if(app.current_snapshot >= begin && app.current_snapshot < end) {
+		float x = min.x + (float) (app.current_snapshot - begin) * size.x / (end - begin);
+		dl->AddLine(ImVec2(x, min.y), ImVec2(x, max.y), IM_COL32(255, 255, 0, 160));
+	}
+	dl->PopClipRect();
+	
+	// Hover to inspect and click to jump.
+	double position;
+	if(strip_input(timeline.view, (double) app.snapshots.size(), 16.0, min, size, position)) {
+		std::size_t snapshot = std::min((std::size_t) position, end - 1);
+		u32 pc = pc_at(app, snapshot);
+		ImGui::SetTooltip("Snapshot %lu\n%s", snapshot, app.instructions[pc / INSN_PAIR_SIZE].disassembly.c_str());
+		
+		if(ImGui::IsItemClicked(ImGuiMouseButton_Left)) {
+			app.current_snapshot = snapshot;
+			app.snapshots_scroll_to = true;
+			app.disassembly_scroll_to = true;
+		}
+	}
+}
+
+void build_timeline(AppState &app)
+{
+	Timeline &timeline = app.timeline;
+	timeline.pcs.levels.clear();
+	timeline.pcs.bucket_size = TIMELINE_BUCKET;
+	
+	// Within a path entry the PC increases by one instruction pair per
+	// snapshot, so the range of each bucket can be worked out from the
+	// entries that overlap it without visiting every snapshot.
+	std::size_t snapshot_count = app.snapshots.size();
+	std::size_t bucket_count = (snapshot_count + TIMELINE_BUCKET - 1) / TIMELINE_BUCKET;
+	timeline.pcs.levels.emplace_back(bucket_count, std::pair<u16, u16>(0xffff, 0));
+	std::vector<std::pair<u16, u16>> &finest = timeline.pcs.levels.back();
+	for(std::size_t i = 0; i < app.path.size(); i++) {
+		std::size_t entry_begin = app.path[i].snapshot;
+		std::size_t entry_end = i + 1 < app.path.size() ? app.path[i + 1].snapshot : snapshot_count;
+		u32 block_begin = app.blocks[app.path[i].block].begin;
+		for(std::size_t bucket = entry_begin / TIMELINE_BUCKET; bucket * TIMELINE_BUCKET < entry_end; bucket++) {
+			std::size_t first = std::max(entry_begin, bucket * TIMELINE_BUCKET);
+			std::size_t last = std::min(entry_end, (bucket + 1) * TIMELINE_BUCKET) - 1;
+			u16 low = block_begin + (first - entry_begin) * INSN_PAIR_SIZE;
+			u16 high = block_begin + (last - entry_begin) * INSN_PAIR_SIZE;
+			finest[bucket].first = std::min(finest[bucket].first, low);
+			finest[bucket].second = std::max(finest[bucket].second, high);
+		}
+	}
+	
+	timeline.lowest_pc = VU1_PROGSIZE;
+	timeline.highest_pc = 0;
+	for(const std::pair<u16, u16> &bucket : finest) {
+		timeline.lowest_pc = std::min(timeline.lowest_pc, (u32) bucket.first);
+		timeline.highest_pc = std::max(timeline.highest_pc, (u32) bucket.second);
+	}
+	
+	build_coarser_levels(timeline.pcs);
+}
+
+std::pair<u16, u16> timeline_range(AppState &app, std::size_t begin, std::size_t end)
+{
+	std::pair<u16, u16> range(0xffff, 0);
+	
+	// Short ranges are read straight from the path.
+	if(end - begin < TIMELINE_BUCKET * 2) {
+		for(std::size_t i = begin; i < end; i++) {
+			u16 pc = pc_at(app, i);
+			range = {std::min(range.first, pc), std::max(range.second, pc)};
+		}
+		return range;
+	}
+	
+	include_pyramid_range(app.timeline.pcs, begin, end, range);
+	return range;
+}
+
+ImU32 timeline_block_colour(u32 block)
+{
+	// Spread the hues of neighbouring blocks out using the golden ratio.
+	float hue = fmodf(block * 0.618034f, 1.f);
+	return ImColor::HSV(hue, 0.55f, 0.9f);
+}
+
+void classify_memory(AppState &app)
+{
+	app.memory_usage.assign(VU1_MEMSIZE / 0x10, QuadwordUsage());
+	std::vector<std::size_t> first_store(VU1_MEMSIZE / 0x10, SIZE_MAX);
+	std::vector<bool> kicked_after_store(VU1_MEMSIZE / 0x10, false);
+	for(std::size_t i = 1; i < app.snapshots.size(); i++) {
+		Snapshot &snap = app.snapshots[i];
+		if(snap.read_size > 0) {
+			app.memory_usage[(snap.read_addr & (VU1_MEMSIZE - 1)) / 0x10].loads++;
+		}
+		if(snap.write_size > 0) {
+			u32 quadword = (snap.write_addr & (VU1_MEMSIZE - 1)) / 0x10;
+			app.memory_usage[quadword].stores++;
+			first_store[quadword] = std::min(first_store[quadword], i);
+		}
+	}
+	for(const std::pair<u32, u32> &write : app.external_writes) {
+		app.memory_usage[(write.second - MEMORY_LOCATION) / 4].uploads++;
+	}
+	// A store is recorded in the snapshot after the instruction, so it has
+	// landed by the time an XGKICK at the same snapshot index executes.
+	for(std::size_t snapshot : app.events[EVENT_XGKICK]) {
+		Snapshot &snap = app.snapshots[snapshot];
+		u32 is = snapshot_ops(app, snapshot).lower.uses[0].reg - VUREG_VI;
+		u32 address = (snap.registers.VI[is].UL * 0x10) & (VU1_MEMSIZE - 1);
+		u32 size = gs_packet_size(&snap.memory[address], VU1_MEMSIZE - address);
+		for(u32 quadword = address / 0x10; quadword < (address + size) / 0x10; quadword++) {
+			app.memory_usage[quadword].kicks++;
+			if(snapshot >= first_store[quadword]) {
+				kicked_after_store[quadword] = true;
+			}
+		}
+	}
+	for(std::size_t quadword = 0; quadword < app.memory_usage.size(); quadword++) {
+		QuadwordUsage &usage = app.memory_usage[quadword];
+		if(usage.stores > 0) {
+			if(kicked_after_store[quadword]) {
+				usage.type = MEMCLASS_KICKED;
+			} else {
+				usage.type = usage.loads > 0 ? MEMCLASS_SCRATCH : MEMCLASS_WRITE_ONLY;
+			}
+		} else if(usage.loads > 0 || usage.kicks > 0) {
+			usage.type = MEMCLASS_READ_ONLY;
+		}
+	}
+}
+
+void export_memory_map(AppState &app, const std::string &path)
+{
+	FILE *file = fopen(path.c_str(), "w");
+	if(!file) {
+		fprintf(stderr, "Failed to open %s for writing.\n", path.c_str());
+		return;
+	}
+	fprintf(file, "# begin end class loads stores kicks vif_writes\n");
+	for(std::size_t begin = 0; begin < app.memory_usage.size();) {
+		const QuadwordUsage &first = app.memory_usage[begin];
+		std::size_t end = begin + 1;
+		QuadwordUsage total = first;
+		for(; end < app.memory_usage.size() && app.memory_usage[end].type == first.type; end++) {
+			total.loads += app.memory_usage[end].loads;
+			total.stores += app.memory_usage[end].stores;
+			total.kicks += app.memory_usage[end].kicks;
+			total.uploads += app.memory_usage[end].uploads;
+		}
+		fprintf(file, "0x%04lx 0x%04lx %s %u %u %u %u\n", begin * 0x10, end * 0x10, memory_class_name(first.type),
+			total.loads, total.stores, total.kicks, total.uploads);
+		begin = end;
+	}
+	fclose(file);
+}
+
+const char *memory_class_name(MemoryClass type)
+{
+	switch(type) {
+		case MEMCLASS_UNTOUCHED: return "untouched";
+		case MEMCLASS_READ_ONLY: return "read_only";
+		case MEMCLASS_KICKED: return "kicked";
+		case MEMCLASS_SCRATCH: return "scratch";
+		case MEMCLASS_WRITE_ONLY: return "write_only";
+		default: return "";
+	}
+}
+
+void build_path(AppState &app)
+{
+	// Blocks start at branch targets and after the delay slots of branches
+	// and E bits. The instructions are decoded from each snapshot's own
+	// program so earlier microprograms are split in the right places.
+	std::vector<bool> is_leader(app.instructions.size(), false);
+	is_leader[0] = true;
+	if(!app.snapshots.empty()) {
+		is_leader[app.snapshots[0].registers.VI[TPC].UL / INSN_PAIR_SIZE] = true;
+	}
+	for(std::size_t i = 0; i < app.instructions.size(); i++) {
+		if(!app.instructions[i].branch_from_times.empty()) {
+			is_leader[i] = true;
+		}
+	}
+	for(std::size_t i = 0; i < app.snapshots.size(); i++) {
+		u32 index = app.snapshots[i].registers.VI[TPC].UL / INSN_PAIR_SIZE;
+		if(index + 2 >= app.instructions.size() || is_leader[index + 2]) {
+			continue;
+		}
+		VuInsnPair ops = snapshot_ops(app, i);
+		if(ops.lower.flow != VUFLOW_NONE || ops.is_end) {
+			is_leader[index + 2] = true;
+		}
+	}
+	app.blocks.clear();
+	app.block_of.resize(app.instructions.size());
+	for(std::size_t i = 0; i < app.instructions.size(); i++) {
+		if(is_leader[i]) {
+			app.blocks.push_back({(u32) i * INSN_PAIR_SIZE, (u32) i * INSN_PAIR_SIZE});
+		}
+		app.blocks.back().end += INSN_PAIR_SIZE;
+		app.block_of[i] = app.blocks.size() - 1;
+	}
+	
+	app.path.clear();
+	u32 last_pc = 0;
+	for(std::size_t i = 0; i < app.snapshots.size(); i++) {
+		u32 pc = app.snapshots[i].registers.VI[TPC].UL;
+		if(i == 0 || pc != last_pc + INSN_PAIR_SIZE || is_leader[pc / INSN_PAIR_SIZE]) {
+			app.path.push_back({app.block_of[pc / INSN_PAIR_SIZE], (u32) i});
+		}
+		last_pc = pc;
+	}
+}
+
+std::size_t path_index_at(AppState &app, std::size_t snapshot)
+{
+	auto entry = std::upper_bound(app.path.begin(), app.path.end(), snapshot,
+		[](std::size_t snapshot, const PathEntry &entry) { return snapshot < entry.snapshot; });
+	return entry - app.path.begin() - 1;
+}
+
+u32 pc_at(AppState &app, std::size_t snapshot)
+{
+	const PathEntry &entry = app.path[path_index_at(app, snapshot)];
+	return app.blocks[entry.block].begin + (snapshot - entry.snapshot) * INSN_PAIR_SIZE;
+}
+
+void find_loop_variants(AppState &app)
+{
+	LoopTable &table = app.loop_table;
+	table.variants_head = table.head;
+	table.variants.clear();
+	table.variant_count = 0;
+	
+	// The body of the loop runs from the head to the furthest branch back to it.
+	u32 latch = table.head;
+	const Instruction &head = app.instructions[table.head / INSN_PAIR_SIZE];
+	for(auto &branch : head.branch_from_times) {
+		if(branch.first >= table.head) {
+			latch = std::max(latch, branch.first);
+		}
+	}
+	u32 first_block = app.block_of[table.head / INSN_PAIR_SIZE];
+	u32 last_block = app.block_of[latch / INSN_PAIR_SIZE];
+	
+	// Hash the blocks entered during each iteration and number the distinct
+	// sequences by how common they are.
+	std::vector<u64> hashes;
+	std::map<u64, std::size_t> frequencies;
+	for(std::size_t snapshot : head.executions) {
+		u64 hash = 14695981039346656037ull;
+		for(std::size_t i = path_index_at(app, snapshot); i < app.path.size(); i++) {
+			u32 block = app.path[i].block;
+			if(block < first_block || block > last_block || (block == first_block && app.path[i].snapshot != snapshot)) {
+				break;
+			}
+			hash = (hash ^ block) * 1099511628211ull;
+		}
+		hashes.push_back(hash);
+		frequencies[hash]++;
+	}
+	std::vector<std::pair<std::size_t, u64>> order;
+	for(auto &frequency : frequencies) {
+		order.emplace_back(frequency.second, frequency.first);
+	}
+	std::sort(order.begin(), order.end(), std::greater<std::pair<std::size_t, u64>>());
+	std::map<u64, u32> variant_of;
+	for(std::size_t i = 0; i < order.size(); i++) {
+		variant_of[order[i].second] = i;
+	}
+	for(u64 hash : hashes) {
+		table.variants.push_back(variant_of[hash]);
+	}
+	table.variant_count = order.size();
+}
 
-		if(instruction.branch_from_times.size() > 0) {
-			std::stringstream addresses;
-			std::size_t fallthrough_times = app.instructions[i / 8 + 1].times_executed;
-			for(auto addrtimes = instruction.branch_from_times.begin(); addrtimes != instruction.branch_from_times.end(); addrtimes++) {
-				addresses << std::hex << addrtimes->first << " (" << std::dec << addrtimes->second << ") ";
-				fallthrough_times -= addrtimes->second;
-			}
-			ImGui::Text("  %s/ ft (%ld) ->", addresses.str().c_str(), fallthrough_times);
+void build_call_index(AppState &app)
+{
+	app.frames.clear();
+	app.frames.push_back({0, SIZE_MAX, 0, 0, 0, 0});
+	app.frame_of.resize(app.snapshots.size());
+	
+	// Calls and returns take effect after their delay slots.
+	u32 frame = 0;
+	std::size_t switch_at = SIZE_MAX;
+	u32 switch_to = 0;
+	std::size_t entry = 0;
+	for(std::size_t i = 0; i < app.snapshots.size(); i++) {
+		if(i == switch_at) {
+			frame = switch_to;
+			switch_at = SIZE_MAX;
 		}
-
-		bool is_highlighted =
-				app.disassembly_highlight.size() > 0 &&
-				disassembly.find(app.disassembly_highlight) != std::string::npos;
-
-		if(is_highlighted) {
-			ImGui::PushStyleColor(ImGuiCol_Text, ImColor(255, 255, 0).Value);
+		app.frame_of[i] = frame;
+		
+		if(entry + 1 < app.path.size() && app.path[entry + 1].snapshot == i) {
+			entry++;
 		}
-		bool clicked = ImGui::Selectable(disassembly.c_str(), is_pc, flags);
-		if(is_highlighted) {
-			ImGui::PopStyleColor();
+		u32 pc = app.blocks[app.path[entry].block].begin + (i - app.path[entry].snapshot) * INSN_PAIR_SIZE;
+		VuInsnPair ops = snapshot_ops(app, i);
+		if(i + 2 >= app.snapshots.size() || (!ops.is_end && ops.lower.flow == VUFLOW_NONE)) {
+			continue;
 		}
-
-		if(instruction.branch_to_times.size() > 0) {
-			std::stringstream addresses;
-			std::size_t fallthrough_times = instruction.times_executed;
-			for(auto addrtimes = instruction.branch_to_times.begin(); addrtimes != instruction.branch_to_times.end(); addrtimes++) {
-				addresses << std::hex << addrtimes->first << " (" << std::dec << addrtimes->second << ") ";
-				fallthrough_times -= addrtimes->second;
+		u32 target = pc_at(app, i + 2);
+		if(ops.is_end) {
+			switch_at = i + 2;
+			switch_to = 0;
+		} else if(ops.lower.flow == VUFLOW_CALL) {
+			app.frames.push_back({i, SIZE_MAX, frame, app.frames[frame].depth + 1, target, pc + INSN_PAIR_SIZE * 2});
+			switch_at = i + 2;
+			switch_to = app.frames.size() - 1;
+		} else if(ops.lower.flow == VUFLOW_JUMP) {
+			// It's only a return if it goes back to where an open call would
+			// have returned to. Any frames in between are unwound.
+			for(u32 f = frame; f != 0; f = app.frames[f].parent) {
+				if(app.frames[f].return_address == target) {
+					for(u32 g = frame; g != app.frames[f].parent; g = app.frames[g].parent) {
+						app.frames[g].return_snapshot = i + 2;
+					}
+					switch_at = i + 2;
+					switch_to = app.frames[f].parent;
+					break;
+				}
 			}
-			ImGui::Text("  -> %s/ ft (%ld)", addresses.str().c_str(), fallthrough_times);
 		}
+	}
+}
 
-		if(is_pc && app.disassembly_scroll_to) {
-			ImGui::SetScrollHereY(0.5);
-			app.disassembly_scroll_to = false;
+bool step_over(AppState &app, int step)
+{
+	ScopedTimer timer(TIMER_NAVIGATION);
+	std::size_t snapshot = app.current_snapshot;
+	if(-step > (int) snapshot || snapshot + step >= app.snapshots.size()) {
+		return false;
+	}
+	std::size_t next = snapshot + step;
+	
+	// If the next instruction is inside a call made from this frame, skip to
+	// the other side of the call.
+	u32 frame = app.frame_of[snapshot];
+	u32 callee = app.frame_of[next];
+	if(app.frames[callee].depth > app.frames[frame].depth) {
+		while(callee != 0 && app.frames[callee].parent != frame) {
+			callee = app.frames[callee].parent;
 		}
-
-		if(!is_pc && clicked) {
-			bool pc_changed = false;
-			if(current.registers.VI[TPC].UL > i) {
-				pc_changed = walk_until_pc_equal(app, i, -1);
-				if(!pc_changed) {
-					pc_changed = walk_until_pc_equal(app, i, 1);
+		if(callee != 0) {
+			if(step > 0) {
+				if(app.frames[callee].return_snapshot == SIZE_MAX) {
+					return false;
 				}
+				next = app.frames[callee].return_snapshot;
 			} else {
-				pc_changed = walk_until_pc_equal(app, i, 1);
-				if(!pc_changed) {
-					pc_changed = walk_until_pc_equal(app, i, -1);
-				}
-			}
-			if(pc_changed) {
-				app.disassembly_scroll_to = true;
+				next = app.frames[callee].call + 1;
 			}
 		}
+	}
+	
+	app.current_snapshot = next;
+	app.snapshots_scroll_to = true;
+	app.disassembly_scroll_to = true;
+	return true;
+}
 
-		ImGui::TableSetColumnIndex(1);
-		
-		if(!is_pc) {
-			ImGui::PushStyleColor(ImGuiCol_FrameBg, ImVec4(0.f, 0.f, 0.f, 0.f));
-		}
-		ImVec2 comment_size(ImGui::GetWindowSize().x - 768.f, 14.f);
-		std::string &comment = app.comments.at(i / INSN_PAIR_SIZE);
-		ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(0, 0));
-		ImGui::PushItemWidth(-1);
-		ImGuiInputTextFlags comment_flags = app.comments_loaded ?
-											ImGuiInputTextFlags_None :
-											ImGuiInputTextFlags_ReadOnly;
-		if(ImGui::InputText("##comment", &comment, comment_flags)) {
-			save_comment_file(app);
-		}
-		ImGui::PopItemWidth();
-		ImGui::PopStyleVar();
-		if(!is_pc) {
-			ImGui::PopStyleColor();
-		}
+bool step_out(AppState &app, int step)
+{
+	ScopedTimer timer(TIMER_NAVIGATION);
+	const CallFrame &frame = app.frames[app.frame_of[app.current_snapshot]];
+	if(app.frame_of[app.current_snapshot] == 0 || (step > 0 && frame.return_snapshot == SIZE_MAX)) {
+		return false;
+	}
+	app.current_snapshot = step > 0 ? frame.return_snapshot : frame.call;
+	app.snapshots_scroll_to = true;
+	app.disassembly_scroll_to = true;
+	return true;
+}
 
+void call_stack_window(AppState &app)
+{
+	ScopedTimer timer(TIMER_CALL_STACK_WINDOW);
+	u32 frame = app.frame_of[app.current_snapshot];
+	u32 pc = app.snapshots[app.current_snapshot].registers.VI[TPC].UL;
+	ImGui::Text("%x (current)", pc);
+	for(; frame != 0; frame = app.frames[frame].parent) {
+		const CallFrame &call = app.frames[frame];
+		u32 call_pc = app.snapshots[call.call].registers.VI[TPC].UL;
+		char label[128];
+		if(call.return_snapshot == SIZE_MAX) {
+			snprintf(label, sizeof(label), "%x called %x at %lu, never returned", call_pc, call.target, call.call);
+		} else {
+			snprintf(label, sizeof(label), "%x called %x at %lu, returned at %lu", call_pc, call.target, call.call, call.return_snapshot);
+		}
+		ImGui::PushID(frame);
+		if(ImGui::Selectable(label)) {
+			app.current_snapshot = call.call;
+			app.snapshots_scroll_to = true;
+			app.disassembly_scroll_to = true;
+		}
 		ImGui::PopID();
 	}
-
-	ImGui::EndTable();
-	ImGui::EndChild();
 }
 
-void gs_packet_window(AppState &app)
+void init_profile(Instruction &instruction)
 {
-	ImGui::Columns(2);
-	
-	static std::string address_hex;
-	ImGui::InputText("Address", &address_hex);
-	
-	Snapshot &snap = app.snapshots[app.current_snapshot];
-	
-	std::size_t address;
-	if(address_hex.size() == 0) {
-		u32 pc = snap.registers.VI[TPC].UL;
-		u32 lower = *(u32*) &snap.program[pc];
-		if(is_xgkick(lower)) {
-			u32 is = bit_range(lower, 11, 15);
-			address = snap.registers.VI[is].UL * 0x10;
-		} else {
+	instruction.operands.clear();
+	auto add = [&](const VuOperand &operand, bool is_def) {
+		if(operand.reg == VUREG_MEMORY || operand.reg == VUREG_VF || operand.reg == VUREG_VI) {
 			return;
 		}
-	} else {
-		address = from_hex(address_hex);
-	}
-	
-	if(address < 0) address = 0;
-	if(address > VU1_MEMSIZE) address = VU1_MEMSIZE;
-	
-	GsPacket packet = read_gs_packet(&snap.memory[address], VU1_MEMSIZE - address);
-	
-	ImGui::BeginChild("primlist");
-	
-	static std::size_t selected_primitive = 0;
-	for(std::size_t i = 0; i < packet.primitives.size(); i++) {
-		std::string label = std::to_string(i);
-		if(ImGui::Selectable(label.c_str(), i == selected_primitive)) {
-			selected_primitive = i;
+		if(is_def && (operand.reg == VUREG_MAC || operand.reg == VUREG_STATUS)) {
+			return; // Written by almost every FMAC instruction.
 		}
+		if(is_def && (operand.reg == VUREG_Q || operand.reg == VUREG_P)) {
+			return; // Written by the FDIV unit and the EFU after a delay.
+		}
+		for(OperandProfile &existing : instruction.operands) {
+			if(existing.reg == operand.reg && existing.is_def == is_def) {
+				existing.lanes |= operand.lanes;
+				return;
+			}
+		}
+		OperandProfile profile;
+		profile.reg = operand.reg;
+		profile.lanes = operand.lanes;
+		profile.is_def = is_def;
+		instruction.operands.push_back(profile);
+	};
+	for(const VuInsn *half : {&instruction.ops.upper, &instruction.ops.lower}) {
+		for(int i = 0; i < half->use_count; i++) add(half->uses[i], false);
+		for(int i = 0; i < half->def_count; i++) add(half->defs[i], true);
 	}
-	if(selected_primitive >= packet.primitives.size()) {
-		selected_primitive = 0;
-	}
-	
-	ImGui::EndChild();
-	ImGui::NextColumn();
-	
-	if(packet.primitives.size() < 1) {
-		return;
-	}
-	const GsPrimitive &prim = packet.primitives[selected_primitive];
-	const GifTag &tag = prim.tag;
-	
-	ImGui::TextWrapped("NLOOP=%x, EOP=%x, PRE=%x, FLAG=%s, NREG=%lx\n",
-		tag.nloop, tag.eop, tag.pre, gif_flag_name(tag.flag), tag.regs.size());
-	
-	ImGui::TextWrapped("PRIM: PRIM=%s, IIP=%s, TME=%d, FGE=%d, ABE=%d, AA1=%d, FST=%s, CTXT=%s, FIX=%d",
-		gs_primitive_type_name(tag.prim.prim),
-		tag.prim.iip == GSSHADE_FLAT ? "FLAT" : "GOURAUD",
-		tag.prim.tme, tag.prim.fge, tag.prim.abe, tag.prim.aa1,
-		tag.prim.fst == GSFST_STQ ? "STQ" : "UV",
-		tag.prim.ctxt == GSCTXT_1 ? "FIRST" : "SECOND",
-		tag.prim.fix);
-	
-	
-	ImGui::TextWrapped("REGS:");
-	ImGui::SameLine();
-	for(std::size_t i = 0; i < tag.regs.size(); i++) {
-		ImGui::TextWrapped("%s", gs_register_name(tag.regs[i]));
-		ImGui::SameLine();
-	}
-	ImGui::NewLine();
-	
-	ImGui::BeginChild("data");
-	for(const GsPackedData& item : prim.packed_data) {
-		ImGui::Text("%x: %6s", item.source_address, gs_register_name(item.reg));
-		ImGui::SameLine();
-		switch(item.reg) {
-			case GSREG_AD: {
-				ImGui::Text("%s <- %lx\n", gif_ad_register_name(item.ad.addr), item.ad.data);
-				break;
+	std::stable_partition(instruction.operands.begin(), instruction.operands.end(),
+		[](const OperandProfile &operand) { return !operand.is_def; });
+}
+
+void profile_instruction(Instruction &instruction, Snapshot &before, Snapshot &after)
+{
+	for(OperandProfile &operand : instruction.operands) {
+		const u32 *value = location_pointer(operand.is_def ? after : before, operand.reg * 4);
+		std::array<u32, 4> masked = {};
+		for(int lane = 0; lane < 4; lane++) {
+			if(!(operand.lanes & (1 << lane))) {
+				continue;
 			}
-			case GSREG_XYZF2: {
-				ImGui::Text("%d %d %d F=%d ADC=%d",
-					item.xyzf2.x, item.xyzf2.y, item.xyzf2.z, item.xyzf2.f, item.xyzf2.adc);
-				break;
+			masked[lane] = value[lane];
+			double number;
+			if(operand.reg < VUREG_VI || operand.reg >= VUREG_ACC || operand.reg == VUREG_I) {
+				float f;
+				memcpy(&f, &value[lane], 4);
+				number = f;
+			} else if(operand.reg < VUREG_VI + 16) {
+				number = (s16) value[lane];
+			} else {
+				number = value[lane];
 			}
-			default: {
-				// Hex dump the raw data.
-				for(std::size_t i = 0; i < 0x10; i += 4) {
-					ImGui::Text("%02x%02x%02x%02x",
-						item.buffer[i + 0],
-						item.buffer[i + 1],
-						item.buffer[i + 2],
-						item.buffer[i + 3]);
-					ImGui::SameLine();
+			if(number < operand.min) operand.min = number;
+			if(number > operand.max) operand.max = number;
+		}
+		if(operand.distinct_count <= PROFILE_SKETCH_SIZE) {
+			bool seen = false;
+			for(int i = 0; i < operand.distinct_count && i < PROFILE_SKETCH_SIZE; i++) {
+				seen |= operand.distinct[i] == masked;
+			}
+			if(!seen) {
+				if(operand.distinct_count < PROFILE_SKETCH_SIZE) {
+					operand.distinct[operand.distinct_count] = masked;
 				}
-				ImGui::NewLine();
+				operand.distinct_count++;
 			}
 		}
 	}
-	ImGui::EndChild();
 }
 
-bool walk_until_pc_equal(AppState &app, u32 target_pc, int step)
+std::string format_branches(AppState &app, std::size_t index)
 {
-	std::size_t snapshot = app.current_snapshot;
-	do {
-		if(-step > (int) snapshot || snapshot + step >= app.snapshots.size()) {
-			return false;
+	Instruction &instruction = app.instructions[index];
+	std::stringstream branches;
+	if(instruction.branch_from_times.size() > 0) {
+		std::size_t fallthrough_times = index + 1 < app.instructions.size() ? app.instructions[index + 1].times_executed : 0;
+		for(auto addrtimes = instruction.branch_from_times.begin(); addrtimes != instruction.branch_from_times.end(); addrtimes++) {
+			branches << std::hex << addrtimes->first << " (" << std::dec << addrtimes->second << ") ";
+			fallthrough_times -= addrtimes->second;
 		}
-		snapshot += step;
-	} while(app.snapshots[snapshot].registers.VI[TPC].UL != target_pc);
-	app.current_snapshot = snapshot;
-	app.snapshots_scroll_to = true;
-	return true;
+		branches << "/ ft (" << fallthrough_times << ") ->";
+	}
+	if(instruction.branch_to_times.size() > 0) {
+		std::size_t fallthrough_times = instruction.times_executed;
+		if(instruction.branch_from_times.size() > 0) {
+			branches << "  ";
+		}
+		branches << "-> ";
+		for(auto addrtimes = instruction.branch_to_times.begin(); addrtimes != instruction.branch_to_times.end(); addrtimes++) {
+			branches << std::hex << addrtimes->first << " (" << std::dec << addrtimes->second << ") ";
+			fallthrough_times -= addrtimes->second;
+		}
+		branches << "/ ft (" << fallthrough_times << ")";
+	}
+	return branches.str();
 }
 
-void walk_until_mem_access(AppState &app, u32 address)
+std::string format_profile(const Instruction &instruction)
 {
-	std::size_t snapshot_index = app.current_snapshot;
-	do {
-		snapshot_index = (snapshot_index + 1) % app.snapshots.size();
-		
-		Snapshot &snap = app.snapshots[snapshot_index];
-		if((snap.read_size > 0 && (snap.read_addr / 0x10 == address / 0x10)) ||
-		   (snap.write_size > 0 && (snap.write_addr / 0x10 == address / 0x10))) {
-			if(snapshot_index >= 1) {
-				app.current_snapshot = snapshot_index - 1;
-				app.snapshots_scroll_to = true;
-				app.disassembly_scroll_to = true;
+	std::string result;
+	bool first_def = true;
+	for(const OperandProfile &operand : instruction.operands) {
+		if(operand.distinct_count == 0) {
+			continue;
+		}
+		std::string name = location_name(operand.reg * 4);
+		name = name.substr(0, name.find('.'));
+		char text[128];
+		if(operand.distinct_count == 1 && vu_register_is_vector(operand.reg)) {
+			const std::array<u32, 4> &value = operand.distinct[0];
+			std::string lanes;
+			for(int lane = 0; lane < 4; lane++) {
+				if(operand.lanes & (1 << lane)) {
+					float f;
+					memcpy(&f, &value[lane], 4);
+					char lane_text[32];
+					snprintf(lane_text, sizeof(lane_text), lanes.empty() ? "%g" : " %g", f);
+					lanes += lane_text;
+				}
 			}
-			return;
+			snprintf(text, sizeof(text), "%s=(%s)", name.c_str(), lanes.c_str());
+		} else if(operand.min == operand.max) {
+			snprintf(text, sizeof(text), "%s=%g", name.c_str(), operand.min);
+		} else if(operand.distinct_count <= PROFILE_SKETCH_SIZE) {
+			snprintf(text, sizeof(text), "%s %g..%g (%d values)", name.c_str(), operand.min, operand.max, operand.distinct_count);
+		} else {
+			snprintf(text, sizeof(text), "%s %g..%g", name.c_str(), operand.min, operand.max);
 		}
-	} while(snapshot_index != app.current_snapshot);
+		if(operand.is_def && first_def) {
+			result += result.empty() ? "-> " : " -> ";
+			first_def = false;
+		} else if(!result.empty()) {
+			result += ", ";
+		}
+		result += text;
+	}
+	return result;
 }
 
 enum VUTracePacketType {
@@ -740,28 +4136,44 @@ enum VUTracePacketType {
 	VUTRACE_PATCHMEMORY = 'm'
 };
 
-void parse_trace(AppState &app, std::string trace_file_path)
+// When hashes_only is set only the state hashes are collected and app is left
+// untouched, and a malformed trace is reported through error instead of
+// exiting, so that a comparison trace can't take the whole session down.
+bool parse_trace(AppState &app, std::string trace_file_path, std::vector<u64> *hashes_only, std::string *error)
 {
-	std::vector<Snapshot> snapshots;
+	ScopedTimer timer(TIMER_PARSE);
 	
-	app.trace_file_path = trace_file_path;
+	std::string message;
+	auto fail = [&](const char *what) {
+		if(!hashes_only) {
+			fprintf(stderr, "Error: %s\n", what);
+			exit(1);
+		}
+		if(message.empty()) {
+			message = what;
+		}
+	};
+	auto check_eof = [&](int n) {
+		if(n != 1) {
+			fail("Unexpected end of file.");
+		}
+	};
 	
 	FILE *trace = fopen(trace_file_path.c_str(), "rb");
 	if(trace == nullptr) {
-		fprintf(stderr, "Error: Failed to read trace!\n");
-		exit(1);
-	}
-	
-	app.instructions.resize(VU1_PROGSIZE / INSN_PAIR_SIZE);
-	
-	auto check_eof = [](int n) {
-		if(n != 1) {
-			fprintf(stderr, "Error: Unexpected end of file.\n");
-			exit(1);
+		fail("Failed to read trace!");
+		if(error) {
+			*error = message;
 		}
-	};
+		return false;
+	}
 	
-	app.snapshots = {};
+	if(!hashes_only) {
+		app.trace_file_path = trace_file_path;
+		app.instructions.resize(VU1_PROGSIZE / INSN_PAIR_SIZE);
+		app.changes.resize(LOCATION_COUNT);
+		app.snapshots = {};
+	}
 	
 	char magic[4];
 	u32 version;
@@ -773,29 +4185,68 @@ void parse_trace(AppState &app, std::string trace_file_path)
 		fseek(trace, 0, SEEK_SET);
 	}
 	
-	if(version > 3) {
-		fprintf(stderr, "Format version too new!\n");
-		exit(1);
+	if(message.empty() && version > 3) {
+		fail("Format version too new!");
 	}
 	
-	Snapshot current;
+	Snapshot current = {};
+	// Locations touched since the last snapshot was pushed. These are compared
+	// against the last snapshot to build the change lists.
+	std::vector<u32> dirty_locations;
+	bool registers_dirty = false;
+	bool memory_dirty = false;
+	
+	// The state hash is the XOR of a hash of every word, so it can be updated
+	// by toggling out the old value of a word and toggling in the new one.
+	u64 hash = 0;
+	auto toggle_hash = [&](u32 begin, u32 end) {
+		for(u32 location = begin; location < end; location++) {
+			hash ^= hash_word(location, *location_pointer(current, location));
+		}
+	};
+	toggle_hash(0, LOCATION_COUNT);
+	
 	VUTracePacketType packet_type = VUTRACE_NULLPACKET;
-	while(fread(&packet_type, 1, 1, trace) == 1) {
+	while(message.empty() && fread(&packet_type, 1, 1, trace) == 1) {
 		switch(packet_type) {
 			case VUTRACE_PUSHSNAPSHOT: {
 				if(current.registers.VI[TPC].UL >= VU1_PROGSIZE || current.registers.VI[TPC].UL % INSN_PAIR_SIZE != 0) {
-					fprintf(stderr, "Bad program counter value.\n");
-					exit(1);
+					fail("Bad program counter value.");
+					break;
+				}
+				current.hash = hash;
+				if(hashes_only) {
+					hashes_only->push_back(hash);
+					current.read_size = 0;
+					current.write_size = 0;
+					break;
 				}
 				app.snapshots.push_back(current);
 				
 				u32 pc = current.registers.VI[TPC].UL;
 				Instruction &instruction = app.instructions[pc / INSN_PAIR_SIZE];
+				u64 word;
+				memcpy(&word, &current.program[pc], INSN_PAIR_SIZE);
+				if(!instruction.is_executed || word != instruction.profile_word) {
+					// Start again if a different microprogram has been uploaded.
+					instruction.ops = decode_instruction_pair(&current.program[pc]);
+					instruction.profile_word = word;
+					init_profile(instruction);
+				}
 				instruction.is_executed = true;
+				instruction.executions.push_back(app.snapshots.size() - 1);
 				
 				if(app.snapshots.size() >= 2) {
 					Snapshot &last = app.snapshots.at(app.snapshots.size() - 2);
 					u32 last_pc = last.registers.VI[TPC].UL;
+					Instruction &last_instruction = app.instructions[last_pc / INSN_PAIR_SIZE];
+					profile_instruction(last_instruction, last, app.snapshots.back());
+					if(current.read_size > 0) {
+						record_access(last_instruction.access, current.read_addr & (VU1_MEMSIZE - 1));
+					} else if(current.write_size > 0) {
+						last_instruction.access.is_store = true;
+						record_access(last_instruction.access, current.write_addr & (VU1_MEMSIZE - 1));
+					}
 					if(last_pc + INSN_PAIR_SIZE != pc) {
 						// A branch has taken place.
 						app.instructions[last_pc / INSN_PAIR_SIZE].branch_to_times[pc]++;
@@ -804,6 +4255,25 @@ void parse_trace(AppState &app, std::string trace_file_path)
 				}
 				instruction.times_executed++;
 				
+				if(app.snapshots.size() >= 2) {
+					if(registers_dirty) {
+						for(u32 location = 0; location < MEMORY_LOCATION; location++) {
+							record_change(app, location);
+						}
+					}
+					if(memory_dirty) {
+						for(u32 location = MEMORY_LOCATION; location < LOCATION_COUNT; location++) {
+							record_change(app, location);
+						}
+					}
+					for(u32 location : dirty_locations) {
+						record_change(app, location);
+					}
+				}
+				dirty_locations.clear();
+				registers_dirty = false;
+				memory_dirty = false;
+				
 				current.read_addr = 0;
 				current.read_size = 0;
 				current.write_addr = 0;
@@ -811,6 +4281,7 @@ void parse_trace(AppState &app, std::string trace_file_path)
 				break;
 			}
 			case VUTRACE_SETREGISTERS: {
+				toggle_hash(0, MEMORY_LOCATION);
 				if(version == 1) {
 					old_pcsx2_structs_v1::VURegs old_regs = {};
 					check_eof(fread(&old_regs, sizeof(old_regs), 1, trace));
@@ -834,10 +4305,15 @@ void parse_trace(AppState &app, std::string trace_file_path)
 					check_eof(fread(&current.registers.q, sizeof(current.registers.q), 1, trace));
 					check_eof(fread(&current.registers.p, sizeof(current.registers.p), 1, trace));
 				}
+				toggle_hash(0, MEMORY_LOCATION);
+				registers_dirty = true;
 				break;
 			}
 			case VUTRACE_SETMEMORY: {
+				toggle_hash(MEMORY_LOCATION, LOCATION_COUNT);
 				check_eof(fread(current.memory, VU1_MEMSIZE, 1, trace));
+				toggle_hash(MEMORY_LOCATION, LOCATION_COUNT);
+				memory_dirty = true;
 				break;
 			}
 			case VUTRACE_SETINSTRUCTIONS: {
@@ -859,6 +4335,11 @@ void parse_trace(AppState &app, std::string trace_file_path)
 				u128 data = {};
 				check_eof(fread(&index, sizeof(u8), 1, trace));
 				check_eof(fread(&data, sizeof(u128), 1, trace));
+				if(index >= VUREG_COUNT) {
+					fail("'r' packet has bad register index.");
+					break;
+				}
+				toggle_hash(index * 4, index * 4 + 4);
 				if(index < 32) {
 					memcpy(&current.registers.VF[index], &data, 16);
 				} else if(index < 64) {
@@ -867,11 +4348,14 @@ void parse_trace(AppState &app, std::string trace_file_path)
 					memcpy(&current.registers.ACC, &data, 16);
 				} else if(index == 65) {
 					memcpy(&current.registers.q, &data, 16);
-				} else if(index == 66) {
-					memcpy(&current.registers.p, &data, 16);
 				} else {
-					fprintf(stderr, "Error: 'r' packet has bad register index.\n");
-					exit(1);
+					memcpy(&current.registers.p, &data, 16);
+				}
+				toggle_hash(index * 4, index * 4 + 4);
+				if(!hashes_only) {
+					for(u32 lane = 0; lane < 4; lane++) {
+						dirty_locations.push_back(index * 4 + lane);
+					}
 				}
 				break;
 			}
@@ -881,30 +4365,93 @@ void parse_trace(AppState &app, std::string trace_file_path)
 				check_eof(fread(&address, sizeof(u16), 1, trace));
 				check_eof(fread(&data, sizeof(u32), 1, trace));
 				if(address < VU1_MEMSIZE - 4) {
+					toggle_hash(MEMORY_LOCATION + address / 4, MEMORY_LOCATION + (address + 3) / 4 + 1);
 					memcpy(&current.memory[address], &data, sizeof(data));
+					toggle_hash(MEMORY_LOCATION + address / 4, MEMORY_LOCATION + (address + 3) / 4 + 1);
+					if(!hashes_only) {
+						dirty_locations.push_back(MEMORY_LOCATION + address / 4);
+						dirty_locations.push_back(MEMORY_LOCATION + (address + 3) / 4);
+					}
 				} else {
-					fprintf(stderr, "Error: 'm' packet has address that is too big.\n");
-					exit(1);
+					fail("'m' packet has address that is too big.");
 				}
 				break;
 			}
 			default: {
-				fprintf(stderr, "Error: Invalid packet type 0x%x in trace file at 0x%lx!\n",
+				char what[64];
+				snprintf(what, sizeof(what), "Invalid packet type 0x%x in trace file at 0x%lx!",
 					packet_type, ftell(trace));
-				exit(1);
+				fail(what);
 			}
 		}
 	}
-	if(!feof(trace)) {
-		fprintf(stderr, "Error: Failed to read trace!\n");
-		exit(1);
+	if(message.empty() && !feof(trace)) {
+		fail("Failed to read trace!");
 	}
 	
 	fclose(trace);
-
+	
+	if(hashes_only) {
+		if(error) {
+			*error = message;
+		}
+		return message.empty();
+	}
+	
+	ScopedTimer index_timer(TIMER_INDEX);
 	for(std::size_t i = 0; i < VU1_PROGSIZE; i += INSN_PAIR_SIZE) {
-		app.instructions[i >> 3].disassembly = disassemble(&current.program[i], i);
-	}    
+		{
+			ScopedTimer disassemble_timer(TIMER_DISASSEMBLE);
+			app.instructions[i >> 3].disassembly = disassemble(&current.program[i], i);
+		}
+		app.instructions[i >> 3].ops = decode_instruction_pair(&current.program[i]);
+		Instruction &instruction = app.instructions[i >> 3];
+		u64 word;
+		memcpy(&word, &current.program[i], INSN_PAIR_SIZE);
+		if(word != instruction.profile_word) {
+			instruction.operands.clear(); // Only seen in an earlier microprogram.
+		}
+		end_access_run(instruction.access);
+		instruction.profile = format_access(instruction.access);
+		std::string profile = format_profile(instruction);
+		if(!instruction.profile.empty() && !profile.empty()) {
+			instruction.profile += " | ";
+		}
+		instruction.profile += profile;
+		instruction.branches = format_branches(app, i / INSN_PAIR_SIZE);
+	}
+	find_buffers(app);
+	build_path(app);
+	build_call_index(app);
+	build_event_index(app);
+	classify_memory(app);
+	
+	// A loop head is the target of a branch back to an earlier address. The
+	// jump happens after the delay slot, so check the instruction before it
+	// is a branch in that snapshot's program to rule out JR and microprogram
+	// boundaries.
+	std::vector<bool> is_loop_head(app.instructions.size(), false);
+	for(std::size_t i = 2; i < app.snapshots.size(); i++) {
+		u32 branch_pc = app.snapshots[i - 2].registers.VI[TPC].UL;
+		u32 delay_slot_pc = app.snapshots[i - 1].registers.VI[TPC].UL;
+		u32 target = app.snapshots[i].registers.VI[TPC].UL;
+		if(target > delay_slot_pc || delay_slot_pc != branch_pc + INSN_PAIR_SIZE || is_loop_head[target / INSN_PAIR_SIZE]) {
+			continue;
+		}
+		if(snapshot_ops(app, i - 2).lower.flow == VUFLOW_BRANCH) {
+			is_loop_head[target / INSN_PAIR_SIZE] = true;
+		}
+	}
+	for(std::size_t i = 0; i < is_loop_head.size(); i++) {
+		if(is_loop_head[i]) {
+			app.loop_heads.push_back(i * INSN_PAIR_SIZE);
+		}
+	}
+	if(!app.loop_heads.empty()) {
+		app.loop_table.head = app.loop_heads[0];
+	}
+	compile_loop_columns(app);
+	return true;
 }
 
 void parse_comment_file(AppState &app, std::string comment_file_path) {
@@ -950,8 +4497,7 @@ void init_gui(GLFWwindow **window)
 
 	glfwMaximizeWindow(*window);
 	glfwMakeContextCurrent(*window);
-	tick_rate = glfwGetVideoMode(glfwGetPrimaryMonitor())->refreshRate / 60;
-	glfwSwapInterval(tick_rate); // vsync
+	glfwSwapInterval(1); // vsync
 
 	if(!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
 		fprintf(stderr, "Cannot load GLAD.");
@@ -993,7 +4539,7 @@ void update_font() {
 	require_font_update = false;
 }
 
-void main_menu_bar() {
+void main_menu_bar(AppState &app) {
 	handle_shortcuts();
 	
 	if (ImGui::BeginMainMenuBar()) {
@@ -1004,23 +4550,25 @@ void main_menu_bar() {
 			if(ImGui::MenuItem("Export Disassembly", "Ctrl+D")) {
 				export_box.is_open = true;
 			}
-			ImGui::EndMenu();
-		}
-		if(ImGui::BeginMenu("System")) {
-			
-			if(ImGui::SliderInt("##tickrate", &tick_rate, 0, 5, "App Refresh Rate %d")) {
-				
-				glfwSwapInterval(tick_rate);
+			if(ImGui::MenuItem("Export Memory Map")) {
+				export_memory_map_box.is_open = true;
+			}
+			ImGui::Separator();
+			if(ImGui::MenuItem("Load Query Tabs")) {
+				load_queries_box.is_open = true;
+			}
+			if(ImGui::MenuItem("Save Query Tabs")) {
+				save_queries_box.is_open = true;
 			}
-			
-			ImGui::SetItemTooltip("Limits the application's refresh rate to decrease impact on CPU. Assuming a 60Hz monitor, the default value (1) is enough.\n0 is unlimited, 60Hz / 2 = 30fps, 60Hz / 3 = 20fps, etc.");
-			
 			ImGui::EndMenu();
 		}
 		if(ImGui::BeginMenu("Registers")) {
 			if(ImGui::MenuItem("Show as Hex", "Ctrl+Q", show_as_hex)) {
 				show_as_hex = !show_as_hex;
 			}
+			if(ImGui::MenuItem("Show Sparklines", "", show_sparklines)) {
+				show_sparklines = !show_sparklines;
+			}
 			ImGui::EndMenu();
 		}
 		if(ImGui::BeginMenu("Memory")) {
@@ -1033,11 +4581,42 @@ void main_menu_bar() {
 			if(ImGui::MenuItem("Go To", "Ctrl+G")) {
 				go_to_box.is_open = true;
 			}
+			if(ImGui::MenuItem("Find Value")) {
+				app.value_search.is_open = true;
+			}
+			if(ImGui::MenuItem("Taint Region")) {
+				app.taint.is_open = true;
+			}
 			if(ImGui::SliderInt("##rowsize", &row_size_imgui, 1, 8, "Line Width: %d")) {
 				row_size = row_size_imgui * 4;
 			}
 			ImGui::EndMenu();
 		}
+		if(ImGui::BeginMenu("Analysis")) {
+			if(ImGui::MenuItem("Loop Iterations")) {
+				app.loop_table.is_open = true;
+			}
+			if(ImGui::MenuItem("Float Anomalies")) {
+				app.anomaly_scan.is_open = true;
+			}
+			if(ImGui::MenuItem("Call Stack")) {
+				app.call_stack_open = true;
+			}
+			if(ImGui::MenuItem("State Hashes")) {
+				app.state_hashes.is_open = true;
+			}
+			if(ImGui::MenuItem("Memory Heatmap")) {
+				app.heatmap.is_open = true;
+			}
+			if(ImGui::MenuItem("Timeline")) {
+				app.timeline.is_open = true;
+			}
+			ImGui::Separator();
+			if(ImGui::MenuItem("Performance", "F3", app.performance_open)) {
+				app.performance_open = !app.performance_open;
+			}
+			ImGui::EndMenu();
+		}
 		if(ImGui::BeginMenu("Font")) {
 			if(ImGui::MenuItem("Use Default", "", use_default_font)) {
 				use_default_font = !use_default_font;
@@ -1206,3 +4785,16 @@ size_t from_hex(const std::string& in) {
 	ss >> result;
 	return result; 
 }
+
+void parallel_for(std::size_t count, std::function<void(std::size_t begin, std::size_t end)> func)
+{
+	std::size_t worker_count = std::max(std::thread::hardware_concurrency(), 1u);
+	worker_count = std::min(worker_count, count);
+	std::vector<std::thread> workers;
+	for(std::size_t i = 0; i < worker_count; i++) {
+		workers.emplace_back(func, count * i / worker_count, count * (i + 1) / worker_count);
+	}
+	for(std::thread &worker : workers) {
+		worker.join();
+	}
+}